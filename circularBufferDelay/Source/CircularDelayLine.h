@@ -0,0 +1,639 @@
+/*
+  ==============================================================================
+
+    CircularDelayLine.h
+
+    The ring buffer that used to live inline in processBlock, pulled out so the
+    processor and any future effects can share it.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "MirroredMemoryBlock.h"
+#include "DelayMemoryArena.h"
+#include "DelayMemoryResidency.h"
+#include <array>
+#include <atomic>
+#include <limits>
+#include <memory>
+#include <vector>
+
+//==============================================================================
+/** A contiguous run of samples, pointing straight into delay memory.
+
+    (This is the subset of std::span that the delay code needs, as the project
+    is still built as C++14.)
+*/
+template <typename SampleType>
+struct SampleSpan
+{
+    SampleType* data = nullptr;
+    int size = 0;
+
+    SampleType* begin() const noexcept                  { return data; }
+    SampleType* end() const noexcept                    { return data + size; }
+    bool isEmpty() const noexcept                       { return size == 0; }
+    SampleType& operator[] (int index) const noexcept   { return data[index]; }
+};
+
+/** A window of a ring buffer as the one or two contiguous runs that cover it,
+    in time order. The second run is empty unless the window crosses the wrap
+    point, in which case it starts at the beginning of the buffer.
+*/
+template <typename SampleType>
+struct SplitSpan
+{
+    SampleSpan<SampleType> first, second;
+
+    int size() const noexcept               { return first.size + second.size; }
+    bool isContiguous() const noexcept      { return second.isEmpty(); }
+
+    /** Calls fn (segment, offset) for each non-empty run, where offset is the
+        position of the run's first sample within the whole window.
+    */
+    template <typename Fn>
+    void forEachSegment (Fn&& fn) const
+    {
+        if (! first.isEmpty())   fn (first, 0);
+        if (! second.isEmpty())  fn (second, first.size);
+    }
+};
+
+/** Walks two windows of the same length together, calling
+    fn (runA, runB, offset) for each stretch where both are contiguous.
+    This is how a kernel reads one region of a ring buffer while writing
+    another: there are never more than three stretches.
+*/
+template <typename TypeA, typename TypeB, typename Fn>
+void forEachCommonSegment (const SplitSpan<TypeA>& a, const SplitSpan<TypeB>& b, Fn&& fn)
+{
+    jassert (a.size() == b.size());
+
+    auto total = a.size();
+    auto offset = 0;
+
+    while (offset < total)
+    {
+        auto runA = offset < a.first.size ? SampleSpan<TypeA> { a.first.data + offset, a.first.size - offset }
+                                          : SampleSpan<TypeA> { a.second.data + (offset - a.first.size), total - offset };
+        auto runB = offset < b.first.size ? SampleSpan<TypeB> { b.first.data + offset, b.first.size - offset }
+                                          : SampleSpan<TypeB> { b.second.data + (offset - b.first.size), total - offset };
+
+        auto length = juce::jmin (runA.size, runB.size);
+        fn (SampleSpan<TypeA> { runA.data, length }, SampleSpan<TypeB> { runB.data, length }, offset);
+        offset += length;
+    }
+}
+
+//==============================================================================
+/**
+    A multi-channel circular delay line.
+
+    All channels share one write head. The capacity is always rounded up to a
+    power of two, so positions wrap with a bitmask instead of an integer modulo,
+    and the bulk write/read calls copy at most two contiguous runs per channel.
+
+    The usual pattern per block is: write() every channel, read() or tap() as
+    many times as you like, then advance() once by the block size.
+
+    DSP code that wants to work directly in delay memory can ask for the same
+    windows with getWriteRegion() and getReadRegion() instead, which hand back
+    the contiguous runs without copying anything.
+
+    With Backing::mirrored each channel lives in a MirroredMemoryBlock, so every
+    window is a single contiguous run and kernels never need a wrap check.
+
+    Whatever the backing, the channels are planar, and each one starts on a
+    cache line of its own, so no cache line holds samples from two channels
+    and they can be worked on from different threads without false sharing.
+    (The kernels all run over one channel at a time and the host's buffers
+    are planar too, so an interleaved layout would only add a conversion.)
+
+    Without mirroring, a plain buffer can still carry a few guard samples past
+    its logical end that repeat the first few samples. An interpolator that
+    needs N samples after a read position can then run off the end of the
+    first run of a window by up to N samples without checking for the wrap.
+
+    The memory itself lives in a Storage object, which can be built (and
+    filled with the line's history) on another thread, then handed over with
+    adoptStorage() without allocating - see DelayLineResizer.
+*/
+template <typename SampleType, int NumChannels>
+class CircularDelayLine
+{
+public:
+    //==============================================================================
+    /** What every channel's memory is aligned to. */
+    static constexpr size_t cacheLineSize = 64;
+
+    static_assert (DelayMemoryArena::alignment % cacheLineSize == 0, "pooled channels must start on a cache line too");
+
+    /** Where the delay memory comes from. */
+    enum class Backing
+    {
+        plain,      /**< An ordinary heap buffer per channel, cache-line aligned and padded. */
+        mirrored,   /**< A double-mapped buffer if the platform allows it, otherwise plain. */
+        pooled      /**< Like plain, but from the DelayMemoryArena shared by the whole process. */
+    };
+
+    //==============================================================================
+    /** The memory for every channel of a line at one size. Building one
+        allocates and clears it, and makes it resident as the options ask, so
+        do that away from the audio thread.
+    */
+    class Storage
+    {
+    public:
+        /** See CircularDelayLine::prepare() and setMemoryOptions() for what the arguments mean. */
+        Storage (int numChannelsToUse, int minimumCapacity, Backing backing, int numGuardSamplesToUse,
+                 const DelayMemoryOptions& options = {})
+        {
+            auto faultsBefore = DelayMemoryResidency::getPageFaultCount();
+
+            jassert (numChannelsToUse > 0 && numChannelsToUse <= NumChannels);
+            jassert (minimumCapacity > 0);
+            jassert (numGuardSamplesToUse >= 0);
+
+            numChannels = numChannelsToUse;
+            capacity    = juce::nextPowerOfTwo (minimumCapacity);
+            mirrored    = backing == Backing::mirrored && allocateMirrored();
+            numGuardSamples = mirrored ? 0 : juce::jmin (numGuardSamplesToUse, capacity);
+
+            for (int channel = 0; channel < numChannels; ++channel)
+            {
+                auto& storage = channels[(size_t) channel];
+
+                if (mirrored)
+                {
+                    storage.data = static_cast<SampleType*> (storage.mirrored.getData());
+                }
+                else if (backing == Backing::pooled && storage.pooled.allocate ((size_t) (capacity + numGuardSamples) * sizeof (SampleType) + channelPadding))
+                {
+                    storage.data = static_cast<SampleType*> (storage.pooled.getData());
+                }
+                else
+                {
+                    storage.data = storage.allocatePlain ((size_t) (capacity + numGuardSamples) * sizeof (SampleType));
+                }
+
+                jassert (reinterpret_cast<juce::pointer_sized_uint> (storage.data) % cacheLineSize == 0);
+
+                // plain and pooled memory is cleared there, after huge pages have been asked for; a mirrored
+                // buffer comes zeroed from the system, and is mapped twice but only locked and counted once
+                auto numBytes = (size_t) (mirrored ? capacity : capacity + numGuardSamples) * sizeof (SampleType);
+
+                if (DelayMemoryResidency::makeResident (storage.data, numBytes, options, ! mirrored, mirrored ? 2 : 1))
+                    storage.numBytesLocked = numBytes;
+            }
+
+            // every fault taken while building this is one the audio thread won't take
+            auto faultsAfter = DelayMemoryResidency::getPageFaultCount();
+
+            if (faultsBefore >= 0 && faultsAfter > faultsBefore)
+                DelayMemoryResidency::getCounters().faultsAvoided += faultsAfter - faultsBefore;
+        }
+
+        ~Storage()
+        {
+            for (auto& storage : channels)
+                if (storage.numBytesLocked > 0)
+                    DelayMemoryResidency::unlock (storage.data, storage.numBytesLocked);
+        }
+
+        int getNumChannels() const noexcept     { return numChannels; }
+        int getCapacity() const noexcept        { return capacity; }
+
+    private:
+        friend class CircularDelayLine;
+
+        bool allocateMirrored()
+        {
+            auto numBytes = (size_t) capacity * sizeof (SampleType);
+
+            if (! MirroredMemoryBlock::isSupported() || numBytes % MirroredMemoryBlock::getPageSize() != 0)
+                return false;
+
+            for (int channel = 0; channel < numChannels; ++channel)
+            {
+                if (! channels[(size_t) channel].mirrored.allocate (numBytes))
+                {
+                    for (auto& storage : channels)
+                        storage.mirrored.free();
+
+                    return false;
+                }
+            }
+
+            return true;
+        }
+
+        /** Each plain or pooled channel is followed by one spare cache line (mirrored
+            ones are whole pages of their own anyway). Starting the next channel a
+            line further on keeps it out of the pair of lines the adjacent-line
+            prefetcher fetches along with this channel's last one.
+        */
+        static constexpr size_t channelPadding = cacheLineSize;
+
+        struct ChannelStorage
+        {
+            // (left for makeResident() to clear, and rounded up to whole cache lines plus the padding)
+            SampleType* allocatePlain (size_t numBytes)
+            {
+                auto numBytesPadded = (numBytes + cacheLineSize - 1) / cacheLineSize * cacheLineSize + channelPadding;
+                plain.reset (new char[numBytesPadded + cacheLineSize]);
+
+                auto address = reinterpret_cast<juce::pointer_sized_uint> (plain.get());
+                return reinterpret_cast<SampleType*> (plain.get() + (cacheLineSize - address % cacheLineSize) % cacheLineSize);
+            }
+
+            std::unique_ptr<char[]> plain;
+            MirroredMemoryBlock mirrored;
+            PooledMemoryBlock pooled;
+            SampleType* data = nullptr;
+            size_t numBytesLocked = 0;
+        };
+
+        std::array<ChannelStorage, NumChannels> channels;
+        int numChannels = 0, capacity = 0, numGuardSamples = 0;
+        bool mirrored = false;
+
+        JUCE_DECLARE_NON_COPYABLE (Storage)
+    };
+
+    //==============================================================================
+    CircularDelayLine() = default;
+
+    /** Allocates room for at least minimumCapacity samples per channel and clears
+        the history. The real capacity is the next power of two.
+
+        Asking for Backing::mirrored is only a request: if the buffer is smaller
+        than a page or the mapping fails, the plain buffer is used instead, which
+        isMirrored() will report.
+
+        numGuardSamples is how far past the end of a plain buffer reads may run
+        (mirrored memory doesn't need any).
+    */
+    void prepare (int numChannelsToUse, int minimumCapacity, Backing backing = Backing::plain, int numGuardSamplesToUse = 0)
+    {
+        requestedBacking = backing;
+        requestedGuardSamples = numGuardSamplesToUse;
+        samplesWritten.store (0);
+        staleBefore.store (noStaleHistory);
+
+        adoptStorage (createStorage (numChannelsToUse, minimumCapacity));
+    }
+
+    /** Sets how the memory is made resident (prefaulted, locked, huge pages)
+        from the next prepare() or resize() on.
+    */
+    void setMemoryOptions (const DelayMemoryOptions& newOptions)
+    {
+        memoryOptions = newOptions;
+    }
+
+    /** Changes the size and/or channel count while keeping as much of the
+        history as fits, with the same backing and guard samples as before.
+        This allocates: from the audio thread, use a DelayLineResizer instead.
+    */
+    void resize (int numChannelsToUse, int minimumCapacity)
+    {
+        auto newStorage = createStorage (numChannelsToUse, minimumCapacity);
+        copyHistoryTo (*newStorage, getNumSamplesWritten(), juce::jmin (capacity, newStorage->getCapacity()));
+        adoptStorage (std::move (newStorage));
+    }
+
+    /** Clears the history and moves the write head back to the start. */
+    void reset() noexcept
+    {
+        for (int channel = 0; channel < numChannels; ++channel)
+            juce::FloatVectorOperations::clear (channelData[(size_t) channel], capacity + numGuardSamples);
+
+        samplesWritten.store (0);
+        staleBefore.store (noStaleHistory);
+        writePosition = 0;
+    }
+
+    //==============================================================================
+    /** Clears the history without touching most of the memory: everything
+        written so far reads as silence from now on, for readers that check
+        getNumStaleSamples(), until the writer gets round to overwriting it.
+
+        Only the numSamplesToZero samples just before the write head are
+        actually zeroed, so that reads which straddle the point of the clear
+        (any interpolator's taps, or a delay shorter than a stretch) see
+        silence on the old side of it without having to check. Call it between
+        blocks, not between a write() and its advance().
+    */
+    void clearLazily (int numSamplesToZero) noexcept
+    {
+        numSamplesToZero = juce::jmin (numSamplesToZero, capacity);
+
+        auto now = getNumSamplesWritten();
+        zeroHistory (now - numSamplesToZero, numSamplesToZero);
+        staleBefore.store (now - numSamplesToZero, std::memory_order_release);
+    }
+
+    /** True while some of the history is left over from before the last
+        clearLazily(), i.e. until the writer has been all the way round since.
+    */
+    bool hasStaleHistory() const noexcept
+    {
+        return getNumSamplesWritten() - capacity < staleBefore.load (std::memory_order_acquire);
+    }
+
+    /** Of the window of numSamples starting delayInSamples behind the write head,
+        how many at the start are left over from before the last clearLazily()
+        and should read as silence. 0 (after one comparison) when nothing is.
+    */
+    int getNumStaleSamples (int numSamples, int delayInSamples) const noexcept
+    {
+        if (! hasStaleHistory())
+            return 0;
+
+        auto windowStart = getNumSamplesWritten() - delayInSamples;
+        return (int) juce::jlimit ((juce::int64) 0, (juce::int64) numSamples, staleBefore.load (std::memory_order_acquire) - windowStart);
+    }
+
+    /** Zeroes up to maximumToZero samples of stale history, newest first, and
+        moves the stale boundary down past them, so that readers stop having to
+        check once it's all gone. Stays a maximumBlockSize (and the chunk) clear
+        of the writer, so another thread may call it while the audio thread
+        writes, as long as the writer can't get through that many samples in the
+        time it takes to zero the chunk - which, at the pace audio comes in and
+        for chunks of a few thousand samples, it can't. Not while the storage
+        might be swapped, though: see DelayLineResizer.
+        Returns how many samples it zeroed.
+    */
+    int zeroStaleHistory (int maximumBlockSize, int maximumToZero) noexcept
+    {
+        auto boundary = staleBefore.load (std::memory_order_acquire);
+        auto lowest = getNumSamplesWritten() + maximumBlockSize + maximumToZero - capacity;
+        auto numToZero = (int) juce::jlimit ((juce::int64) 0, (juce::int64) maximumToZero, boundary - lowest);
+
+        if (numToZero == 0)
+            return 0;
+
+        zeroHistory (boundary - numToZero, numToZero);
+
+        // if the audio thread has cleared again meanwhile, the boundary has moved up and this was still stale
+        staleBefore.compare_exchange_strong (boundary, boundary - numToZero, std::memory_order_release);
+        return numToZero;
+    }
+
+    //==============================================================================
+    /** Builds (but doesn't use) storage with this line's backing and guard
+        samples. This allocates, so call it away from the audio thread.
+    */
+    std::unique_ptr<Storage> createStorage (int numChannelsToUse, int minimumCapacity) const
+    {
+        return std::make_unique<Storage> (numChannelsToUse, minimumCapacity, requestedBacking, requestedGuardSamples, memoryOptions);
+    }
+
+    /** Copies the numSamples of history before the absolute sample index upTo
+        into the same positions of some other storage, for the channels both
+        have. Call it from the thread that writes the line (see
+        DelayLineResizer, which copies a slice at a time from the audio thread).
+    */
+    void copyHistoryTo (Storage& dest, juce::int64 upTo, int numSamples) const noexcept
+    {
+        jassert (numSamples >= 0 && numSamples <= juce::jmin (capacity, dest.capacity));
+
+        auto from = upTo - numSamples;
+        auto numCommonChannels = juce::jmin (numChannels, dest.numChannels);
+
+        while (numSamples > 0)
+        {
+            auto source = (int) (from & mask);
+            auto target = (int) (from & (dest.capacity - 1));
+            auto length = juce::jmin (numSamples, capacity - source, dest.capacity - target);
+
+            for (int channel = 0; channel < numCommonChannels; ++channel)
+                juce::FloatVectorOperations::copy (dest.channels[(size_t) channel].data + target,
+                                                   channelData[(size_t) channel] + source, length);
+
+            from += length;
+            numSamples -= length;
+        }
+    }
+
+    /** Switches to different storage and returns the old one, which the caller
+        should free somewhere other than the audio thread. The write head keeps
+        its place in time, so history that was copied across stays where it was.
+        Doesn't allocate or block.
+    */
+    std::unique_ptr<Storage> adoptStorage (std::unique_ptr<Storage> newStorage) noexcept
+    {
+        jassert (newStorage != nullptr);
+
+        std::swap (storage, newStorage);
+
+        numChannels     = storage->numChannels;
+        capacity        = storage->capacity;
+        mask            = capacity - 1;
+        numGuardSamples = storage->numGuardSamples;
+        mirrored        = storage->mirrored;
+
+        for (int channel = 0; channel < NumChannels; ++channel)
+            channelData[(size_t) channel] = storage->channels[(size_t) channel].data;
+
+        writePosition = (int) (getNumSamplesWritten() & mask);
+
+        // whatever was copied into the start of the buffer isn't in its guard samples yet
+        for (int channel = 0; channel < numChannels; ++channel)
+            juce::FloatVectorOperations::copy (channelData[(size_t) channel] + capacity, channelData[(size_t) channel], numGuardSamples);
+
+        return newStorage;
+    }
+
+    //==============================================================================
+    /** True if the memory is double-mapped, so regions never come back split. */
+    bool isMirrored() const noexcept        { return mirrored; }
+
+    /** How many samples past the end of the first run of any region can be read
+        safely. Unlimited (well, up to the capacity) when mirrored.
+    */
+    int getNumGuardSamples() const noexcept { return mirrored ? capacity : numGuardSamples; }
+
+    int getNumChannels() const noexcept     { return numChannels; }
+    int getCapacity() const noexcept        { return capacity; }
+    int getWritePosition() const noexcept   { return writePosition; }
+
+    /** The total number of samples advance() has moved on by since prepare(),
+        i.e. the absolute index of the write head. Safe to call from any thread.
+    */
+    juce::int64 getNumSamplesWritten() const noexcept   { return samplesWritten.load (std::memory_order_acquire); }
+
+    /** The longest delay that read() and tap() can serve. */
+    int getMaximumDelay() const noexcept    { return capacity; }
+
+    /** The start of a channel's memory, for kernels that do their own indexing:
+        any position masked with getCapacity() - 1, plus up to
+        getNumGuardSamples() samples after it, is safe to read.
+    */
+    const SampleType* getChannelPointer (int channel) const noexcept
+    {
+        jassert (juce::isPositiveAndBelow (channel, numChannels));
+        return channelData[(size_t) channel];
+    }
+
+    /** The writable version of getChannelPointer(), for kernels that write at
+        their own positions. Guard samples still only catch up on advance().
+    */
+    SampleType* getChannelPointer (int channel) noexcept
+    {
+        jassert (juce::isPositiveAndBelow (channel, numChannels));
+        return channelData[(size_t) channel];
+    }
+
+    //==============================================================================
+    /** Returns the window of numSamples starting at the write head, i.e. where
+        the next write() of that length would land.
+    */
+    SplitSpan<SampleType> getWriteRegion (int channel, int numSamples) noexcept
+    {
+        jassert (juce::isPositiveAndBelow (channel, numChannels));
+
+        return makeRegion (channelData[(size_t) channel], writePosition, numSamples);
+    }
+
+    /** Returns the window of numSamples starting delayInSamples behind the write
+        head, i.e. what read() with the same arguments would copy out.
+    */
+    SplitSpan<const SampleType> getReadRegion (int channel, int numSamples, int delayInSamples) const noexcept
+    {
+        jassert (juce::isPositiveAndBelow (channel, numChannels));
+        jassert (delayInSamples >= 0 && delayInSamples <= capacity);
+
+        return makeRegion (static_cast<const SampleType*> (channelData[(size_t) channel]), (writePosition - delayInSamples) & mask, numSamples);
+    }
+
+    //==============================================================================
+    /** Copies numSamples into a channel starting at the write head, scaled by gain.
+        The write head does not move until advance() is called.
+    */
+    void write (int channel, const SampleType* source, int numSamples, SampleType gain = SampleType (1)) noexcept
+    {
+        getWriteRegion (channel, numSamples).forEachSegment ([source, gain] (SampleSpan<SampleType> segment, int offset)
+        {
+            if (gain == SampleType (1))
+                juce::FloatVectorOperations::copy (segment.data, source + offset, segment.size);
+            else
+                juce::FloatVectorOperations::copyWithMultiply (segment.data, source + offset, gain, segment.size);
+        });
+    }
+
+    /** Fills dest with numSamples from a channel, starting delayInSamples behind
+        the write head. Samples written this block (before advance()) are visible,
+        so a delay shorter than the block reads back what was just written.
+    */
+    void read (int channel, SampleType* dest, int numSamples, int delayInSamples) const noexcept
+    {
+        getReadRegion (channel, numSamples, delayInSamples).forEachSegment ([dest] (SampleSpan<const SampleType> segment, int offset)
+        {
+            juce::FloatVectorOperations::copy (dest + offset, segment.data, segment.size);
+        });
+    }
+
+    /** Returns the sample delayInSamples behind the write head. */
+    SampleType tap (int channel, int delayInSamples) const noexcept
+    {
+        jassert (juce::isPositiveAndBelow (channel, numChannels));
+        jassert (delayInSamples >= 0 && delayInSamples <= capacity);
+
+        return channelData[(size_t) channel][(writePosition - delayInSamples) & mask];
+    }
+
+    /** Moves the write head on by numSamples, wrapping at the capacity.
+
+        This is also when the guard samples catch up with whatever was written
+        since the last advance(), so reads that rely on them should come after it.
+    */
+    void advance (int numSamples) noexcept
+    {
+        if (numGuardSamples > 0)
+            updateGuardSamples (numSamples);
+
+        writePosition = (writePosition + numSamples) & mask;
+        samplesWritten.store (samplesWritten.load (std::memory_order_relaxed) + numSamples, std::memory_order_release);
+    }
+
+private:
+    //==============================================================================
+    template <typename Type>
+    SplitSpan<Type> makeRegion (Type* data, int start, int numSamples) const noexcept
+    {
+        jassert (juce::isPositiveAndBelow (start, capacity));
+        jassert (numSamples >= 0 && numSamples <= capacity);
+
+        if (mirrored)
+            return { { data + start, numSamples }, {} };
+
+        auto numToEnd = juce::jmin (numSamples, capacity - start);
+        return { { data + start, numToEnd }, { data, numSamples - numToEnd } };
+    }
+
+    /** Zeroes numSamples of every channel from the absolute sample index from,
+        along with any guard samples that copy them.
+    */
+    void zeroHistory (juce::int64 from, int numSamples) noexcept
+    {
+        while (numSamples > 0)
+        {
+            auto start = (int) (from & mask);
+            auto length = juce::jmin (numSamples, capacity - start);
+            auto numGuarded = juce::jlimit (0, length, numGuardSamples - start);
+
+            for (int channel = 0; channel < numChannels; ++channel)
+            {
+                juce::FloatVectorOperations::clear (channelData[(size_t) channel] + start, length);
+
+                if (numGuarded > 0)
+                    juce::FloatVectorOperations::clear (channelData[(size_t) channel] + capacity + start, numGuarded);
+            }
+
+            from += length;
+            numSamples -= length;
+        }
+    }
+
+    /** Copies whatever part of [writePosition, writePosition + numWritten) landed
+        in the first numGuardSamples samples into the guard area past the end.
+    */
+    void updateGuardSamples (int numWritten) noexcept
+    {
+        auto end = writePosition + numWritten;
+        auto wrapped = end > capacity;
+
+        if (! wrapped && writePosition >= numGuardSamples)
+            return;
+
+        auto from = wrapped ? 0 : writePosition;
+        auto to   = juce::jmin (numGuardSamples, wrapped ? juce::jmax (end - capacity, juce::jmin (end, numGuardSamples)) : end);
+
+        for (int channel = 0; channel < numChannels; ++channel)
+        {
+            auto* data = channelData[(size_t) channel];
+            juce::FloatVectorOperations::copy (data + capacity + from, data + from, to - from);
+        }
+    }
+
+    //==============================================================================
+    std::unique_ptr<Storage> storage;
+    std::array<SampleType*, NumChannels> channelData {};
+    int numChannels = 0, capacity = 0, mask = 0, writePosition = 0, numGuardSamples = 0;
+    bool mirrored = false;
+    std::atomic<juce::int64> samplesWritten { 0 };
+
+    // the absolute index below which the history is left over from before clearLazily()
+    static constexpr juce::int64 noStaleHistory = std::numeric_limits<juce::int64>::min() / 2;
+    std::atomic<juce::int64> staleBefore { noStaleHistory };
+
+    Backing requestedBacking = Backing::plain;
+    int requestedGuardSamples = 0;
+    DelayMemoryOptions memoryOptions;
+
+    JUCE_DECLARE_NON_COPYABLE (CircularDelayLine)
+};
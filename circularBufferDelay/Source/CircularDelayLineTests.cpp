@@ -0,0 +1,143 @@
+/*
+  ==============================================================================
+
+    CircularDelayLineTests.cpp
+
+    Checks the regions CircularDelayLine hands out against a plain per-sample
+    model of the ring buffer. Registered with JUCE's UnitTestRunner by the
+    static instance at the bottom.
+
+  ==============================================================================
+*/
+
+#include "CircularDelayLine.h"
+
+//==============================================================================
+class CircularDelayLineTests  : public juce::UnitTest
+{
+public:
+    CircularDelayLineTests()  : juce::UnitTest ("CircularDelayLine regions", "Delay") {}
+
+    void runTest() override
+    {
+        using Line = CircularDelayLine<float, 2>;
+
+        beginTest ("Plain backing");
+        checkRegions (Line::Backing::plain, 0);
+
+        beginTest ("Plain backing with guard samples");
+        checkRegions (Line::Backing::plain, 4);
+
+        beginTest ("Mirrored backing");
+        checkRegions (Line::Backing::mirrored, 0);
+    }
+
+private:
+    //==============================================================================
+    // Random capacities, windows and delays, driven through the write regions the
+    // way a kernel would; every sample of every region is checked against the model
+    void checkRegions (CircularDelayLine<float, 2>::Backing backing, int numGuardSamples)
+    {
+        auto random = getRandom();
+
+        for (int trial = 0; trial < 10; ++trial)
+        {
+            CircularDelayLine<float, 2> line;
+            line.prepare (2, 1 + random.nextInt (1 << 13), backing, numGuardSamples);
+
+            auto capacity = line.getCapacity();
+            auto mask = capacity - 1;
+            expect (juce::isPowerOfTwo (capacity), "capacity isn't a power of two");
+
+            // what every position of each channel should hold, and where the write head should be
+            std::vector<std::vector<float>> model (2, std::vector<float> ((size_t) capacity, 0.0f));
+            auto writePosition = 0;
+
+            for (int block = 0; block < 30; ++block)
+            {
+                auto numSamples = 1 + random.nextInt (capacity);
+
+                for (int channel = 0; channel < 2; ++channel)
+                {
+                    auto region = line.getWriteRegion (channel, numSamples);
+                    checkShape (line, region, line.getChannelPointer (channel), writePosition, numSamples);
+
+                    region.forEachSegment ([&] (SampleSpan<float> segment, int offset)
+                    {
+                        for (int i = 0; i < segment.size; ++i)
+                        {
+                            auto value = random.nextFloat();
+                            segment[i] = value;
+                            model[(size_t) channel][(size_t) ((writePosition + offset + i) & mask)] = value;
+                        }
+                    });
+                }
+
+                // before advance(), a read with a delay shorter than the window sees what was just written
+                for (int read = 0; read < 4; ++read)
+                    checkRead (line, model, writePosition, random.nextInt (capacity + 1), 1 + random.nextInt (capacity), false);
+
+                line.advance (numSamples);
+                writePosition = (writePosition + numSamples) & mask;
+                expectEquals (line.getWritePosition(), writePosition);
+
+                for (int read = 0; read < 4; ++read)
+                    checkRead (line, model, writePosition, random.nextInt (capacity + 1), 1 + random.nextInt (capacity), true);
+            }
+        }
+    }
+
+    template <typename Type>
+    void checkShape (const CircularDelayLine<float, 2>& line, const SplitSpan<Type>& region,
+                     const float* channelData, int start, int numSamples)
+    {
+        expectEquals (region.size(), numSamples);
+        expect (region.first.data == channelData + start, "region doesn't start at the right place");
+
+        if (line.isMirrored())
+        {
+            expect (region.isContiguous(), "mirrored region came back split");
+        }
+        else
+        {
+            expectEquals (region.first.size, juce::jmin (numSamples, line.getCapacity() - start));
+            expect (region.second.isEmpty() || region.second.data == channelData, "second run doesn't start at the beginning");
+        }
+    }
+
+    void checkRead (const CircularDelayLine<float, 2>& line, const std::vector<std::vector<float>>& model,
+                    int writePosition, int delayInSamples, int numSamples, bool guardSamplesUpToDate)
+    {
+        auto mask = line.getCapacity() - 1;
+        auto start = (writePosition - delayInSamples) & mask;
+
+        for (int channel = 0; channel < 2; ++channel)
+        {
+            auto region = line.getReadRegion (channel, numSamples, delayInSamples);
+            checkShape (line, region, line.getChannelPointer (channel), start, numSamples);
+
+            auto& expected = model[(size_t) channel];
+            auto mismatches = 0;
+
+            region.forEachSegment ([&] (SampleSpan<const float> segment, int offset)
+            {
+                for (int i = 0; i < segment.size; ++i)
+                    if (segment[i] != expected[(size_t) ((start + offset + i) & mask)])
+                        ++mismatches;
+            });
+
+            // the first run can be read on past its end as far as the guard samples go
+            // (they only catch up on advance(), so this is only checked straight after one)
+            auto numPastEnd = juce::jmin (line.getNumGuardSamples(), region.second.size);
+
+            if (guardSamplesUpToDate)
+                for (int i = 0; i < numPastEnd; ++i)
+                    if (region.first.data[region.first.size + i] != expected[(size_t) i])
+                        ++mismatches;
+
+            expectEquals (mismatches, 0, "read region doesn't match the per-sample model");
+        }
+    }
+};
+
+static CircularDelayLineTests circularDelayLineTests;
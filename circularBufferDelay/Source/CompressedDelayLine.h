@@ -0,0 +1,703 @@
+/*
+  ==============================================================================
+
+    CompressedDelayLine.h
+
+    A delay line that keeps its history in fewer bytes than a float per sample,
+    for delays long enough that memory (and the cache misses that come with
+    it) matters more than the last few bits of resolution.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "DelayInterpolation.h"
+#include "DelayKernelDispatch.h"
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+//==============================================================================
+/** How a CompressedDelayLine stores each sample. */
+enum class DelaySampleFormat
+{
+    int16,      /**< 16-bit integers, with a power-of-two scale per block of samples. */
+    half,       /**< IEEE 754 half-precision floats. */
+    packed24    /**< 24-bit integers packed into 3 bytes, with a scale per block. */
+};
+
+//==============================================================================
+/**
+    The conversions between float and the compressed formats.
+
+    The integer formats are block floating point: every blockSize samples share
+    one exponent, picked so that the loudest of them only just fits, which
+    keeps the resolution relative to the signal rather than to full scale.
+    Scaling by a power of two is exact, so the only error is the rounding to an
+    integer.
+
+    encode() and decode() go to the versions for the widest instruction set the
+    machine supports, through DelayKernelDispatch, like the interpolation
+    kernels; the scalar versions are the reference.
+*/
+struct DelaySampleCodecs
+{
+    /** How many samples share an exponent in the integer formats. */
+    static constexpr int blockSize = 32;
+
+    /** Blocks quieter than 2^minimumExponent (about -190 dB) are stored as silence. */
+    static constexpr int minimumExponent = -32;
+    static constexpr int maximumExponent = 32;
+
+    /** The smallest exponent e for which every sample in a block with this peak
+        is below 2^e.
+    */
+    static int getBlockExponent (float peak) noexcept
+    {
+        if (! (peak > 0.0f))
+            return minimumExponent;
+
+        int exponent;
+        std::frexp (peak, &exponent);
+        return juce::jlimit (minimumExponent, maximumExponent, exponent);
+    }
+
+    //==============================================================================
+    struct Int16
+    {
+        using StorageType = std::int16_t;
+        static constexpr int unitsPerSample = 1;
+        static constexpr bool hasBlockExponent = true;
+        static constexpr int bits = 16;
+
+        static void encodeScalar (const float* source, StorageType* dest, int numSamples, float scale) noexcept
+        {
+            for (int i = 0; i < numSamples; ++i)
+                dest[i] = (StorageType) juce::jlimit (-32768L, 32767L, std::lrint (source[i] * scale));
+        }
+
+        static void decodeScalar (const StorageType* source, float* dest, int numSamples, float scale) noexcept
+        {
+            for (int i = 0; i < numSamples; ++i)
+                dest[i] = (float) source[i] * scale;
+        }
+
+       #if JUCE_USE_SSE_INTRINSICS
+        static void encodeSSE2 (const float* source, StorageType* dest, int numSamples, float scale) noexcept
+        {
+            auto s = _mm_set1_ps (scale);
+            int i = 0;
+
+            // rounds to nearest like lrint(), and the pack saturates
+            for (; i + 8 <= numSamples; i += 8)
+            {
+                auto lo = _mm_cvtps_epi32 (_mm_mul_ps (_mm_loadu_ps (source + i), s));
+                auto hi = _mm_cvtps_epi32 (_mm_mul_ps (_mm_loadu_ps (source + i + 4), s));
+                _mm_storeu_si128 (reinterpret_cast<__m128i*> (dest + i), _mm_packs_epi32 (lo, hi));
+            }
+
+            encodeScalar (source + i, dest + i, numSamples - i, scale);
+        }
+
+        static void decodeSSE2 (const StorageType* source, float* dest, int numSamples, float scale) noexcept
+        {
+            auto s = _mm_set1_ps (scale);
+            int i = 0;
+
+            for (; i + 8 <= numSamples; i += 8)
+            {
+                auto v = _mm_loadu_si128 (reinterpret_cast<const __m128i*> (source + i));
+
+                // each sample into the top half of a 32-bit lane, then sign-extended down
+                auto lo = _mm_srai_epi32 (_mm_unpacklo_epi16 (_mm_setzero_si128(), v), 16);
+                auto hi = _mm_srai_epi32 (_mm_unpackhi_epi16 (_mm_setzero_si128(), v), 16);
+
+                _mm_storeu_ps (dest + i,     _mm_mul_ps (_mm_cvtepi32_ps (lo), s));
+                _mm_storeu_ps (dest + i + 4, _mm_mul_ps (_mm_cvtepi32_ps (hi), s));
+            }
+
+            decodeScalar (source + i, dest + i, numSamples - i, scale);
+        }
+       #endif
+
+        static void encode (const float* source, StorageType* dest, int numSamples, float scale) noexcept
+        {
+            DelayKernelDispatch::getKernels().encodeInt16 (source, dest, numSamples, scale);
+        }
+
+        static void decode (const StorageType* source, float* dest, int numSamples, float scale) noexcept
+        {
+            DelayKernelDispatch::getKernels().decodeInt16 (source, dest, numSamples, scale);
+        }
+
+        /** Re-encodes samples for an exponent that has grown by shift. */
+        static void rescale (StorageType* data, int numSamples, int shift) noexcept
+        {
+            shift = juce::jmin (shift, 31);
+
+            for (int i = 0; i < numSamples; ++i)
+                data[i] = (StorageType) (((int) data[i] + (1 << (shift - 1))) >> shift);
+        }
+    };
+
+    //==============================================================================
+    struct Packed24
+    {
+        using StorageType = std::uint8_t;
+        static constexpr int unitsPerSample = 3;
+        static constexpr bool hasBlockExponent = true;
+        static constexpr int bits = 24;
+        static constexpr float largest = 8388607.0f;
+
+        static std::int32_t load (const StorageType* p) noexcept
+        {
+            return (std::int32_t) ((std::uint32_t) p[0] << 8 | (std::uint32_t) p[1] << 16 | (std::uint32_t) p[2] << 24) >> 8;
+        }
+
+        static void store (StorageType* p, std::int32_t value) noexcept
+        {
+            p[0] = (StorageType) value;
+            p[1] = (StorageType) (value >> 8);
+            p[2] = (StorageType) (value >> 16);
+        }
+
+        static void encodeScalar (const float* source, StorageType* dest, int numSamples, float scale) noexcept
+        {
+            for (int i = 0; i < numSamples; ++i)
+                store (dest + 3 * i, (std::int32_t) std::lrint (juce::jlimit (-largest, largest, source[i] * scale)));
+        }
+
+        static void decodeScalar (const StorageType* source, float* dest, int numSamples, float scale) noexcept
+        {
+            for (int i = 0; i < numSamples; ++i)
+                dest[i] = (float) load (source + 3 * i) * scale;
+        }
+
+       #if JUCE_USE_SSE_INTRINSICS
+        DELAY_KERNEL_TARGET_SSSE3
+        static void encodeSSSE3 (const float* source, StorageType* dest, int numSamples, float scale) noexcept
+        {
+            auto s = _mm_set1_ps (scale);
+            auto lowest = _mm_set1_ps (-largest), highest = _mm_set1_ps (largest);
+            auto pack = _mm_setr_epi8 (0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+            int i = 0;
+
+            for (; i + 4 <= numSamples; i += 4)
+            {
+                auto x = _mm_min_ps (_mm_max_ps (_mm_mul_ps (_mm_loadu_ps (source + i), s), lowest), highest);
+                auto packed = _mm_shuffle_epi8 (_mm_cvtps_epi32 (x), pack);
+
+                // exactly 12 bytes, so nothing past the run is touched
+                auto tail = _mm_cvtsi128_si32 (_mm_srli_si128 (packed, 8));
+                _mm_storel_epi64 (reinterpret_cast<__m128i*> (dest + 3 * i), packed);
+                std::memcpy (dest + 3 * i + 8, &tail, 4);
+            }
+
+            encodeScalar (source + i, dest + 3 * i, numSamples - i, scale);
+        }
+
+        /** Reads up to paddingUnits bytes past the last sample. */
+        DELAY_KERNEL_TARGET_SSSE3
+        static void decodeSSSE3 (const StorageType* source, float* dest, int numSamples, float scale) noexcept
+        {
+            auto s = _mm_set1_ps (scale);
+            auto unpack = _mm_setr_epi8 (-1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11);
+            int i = 0;
+
+            for (; i + 4 <= numSamples; i += 4)
+            {
+                auto v = _mm_shuffle_epi8 (_mm_loadu_si128 (reinterpret_cast<const __m128i*> (source + 3 * i)), unpack);
+                _mm_storeu_ps (dest + i, _mm_mul_ps (_mm_cvtepi32_ps (_mm_srai_epi32 (v, 8)), s));
+            }
+
+            decodeScalar (source + 3 * i, dest + i, numSamples - i, scale);
+        }
+       #endif
+
+        static void encode (const float* source, StorageType* dest, int numSamples, float scale) noexcept
+        {
+            DelayKernelDispatch::getKernels().encodePacked24 (source, dest, numSamples, scale);
+        }
+
+        /** Reads up to paddingUnits bytes past the last sample. */
+        static void decode (const StorageType* source, float* dest, int numSamples, float scale) noexcept
+        {
+            DelayKernelDispatch::getKernels().decodePacked24 (source, dest, numSamples, scale);
+        }
+
+        static void rescale (StorageType* data, int numSamples, int shift) noexcept
+        {
+            shift = juce::jmin (shift, 31);
+
+            for (int i = 0; i < numSamples; ++i)
+                store (data + 3 * i, (std::int32_t) (((juce::int64) load (data + 3 * i) + (1 << (shift - 1))) >> shift));
+        }
+    };
+
+    //==============================================================================
+    struct Half
+    {
+        using StorageType = std::uint16_t;
+        static constexpr int unitsPerSample = 1;
+        static constexpr bool hasBlockExponent = false;
+        static constexpr int bits = 11;
+
+        /** Round-to-nearest-even, with overflow to infinity, after F. Giesen's float_to_half_fast3_rtne. */
+        static StorageType fromFloat (float f) noexcept
+        {
+            constexpr std::uint32_t infinity = 255u << 23;
+            constexpr std::uint32_t overflow = (127u + 16u) << 23;
+            constexpr std::uint32_t smallestNormal = 113u << 23;
+            constexpr std::uint32_t denormalMagic = ((127u - 15u) + (23u - 10u) + 1u) << 23;
+
+            std::uint32_t bits;
+            std::memcpy (&bits, &f, 4);
+
+            auto sign = bits & 0x80000000u;
+            bits ^= sign;
+            std::uint32_t result;
+
+            if (bits >= overflow)
+            {
+                result = bits > infinity ? 0x7e00u : 0x7c00u;
+            }
+            else if (bits < smallestNormal)
+            {
+                // let the FPU's rounding do the work of shifting the mantissa down
+                float magic, sum;
+                std::memcpy (&magic, &denormalMagic, 4);
+                std::memcpy (&sum, &bits, 4);
+                sum += magic;
+                std::memcpy (&result, &sum, 4);
+                result -= denormalMagic;
+            }
+            else
+            {
+                auto mantissaIsOdd = (bits >> 13) & 1u;
+                bits += ((15u - 127u) << 23) + 0xfffu + mantissaIsOdd;
+                result = bits >> 13;
+            }
+
+            return (StorageType) (result | (sign >> 16));
+        }
+
+        static float toFloat (StorageType h) noexcept
+        {
+            constexpr std::uint32_t exponentMask = 0x7c00u << 13;
+            constexpr std::uint32_t magic = 113u << 23;
+
+            std::uint32_t bits = ((std::uint32_t) h & 0x7fffu) << 13;
+            auto exponent = bits & exponentMask;
+            bits += (127u - 15u) << 23;
+
+            float result;
+
+            if (exponent == exponentMask)
+            {
+                bits += (128u - 16u) << 23;
+                std::memcpy (&result, &bits, 4);
+            }
+            else if (exponent == 0)
+            {
+                float m;
+                bits += 1u << 23;
+                std::memcpy (&result, &bits, 4);
+                std::memcpy (&m, &magic, 4);
+                result -= m;
+            }
+            else
+            {
+                std::memcpy (&result, &bits, 4);
+            }
+
+            return (h & 0x8000u) != 0 ? -result : result;
+        }
+
+        static void encodeScalar (const float* source, StorageType* dest, int numSamples, float scale) noexcept
+        {
+            for (int i = 0; i < numSamples; ++i)
+                dest[i] = fromFloat (source[i] * scale);
+        }
+
+        static void decodeScalar (const StorageType* source, float* dest, int numSamples, float) noexcept
+        {
+            for (int i = 0; i < numSamples; ++i)
+                dest[i] = toFloat (source[i]);
+        }
+
+       #if JUCE_USE_SSE_INTRINSICS
+        DELAY_KERNEL_TARGET_F16C
+        static void encodeF16C (const float* source, StorageType* dest, int numSamples, float scale) noexcept
+        {
+            auto s = _mm256_set1_ps (scale);
+            int i = 0;
+
+            for (; i + 8 <= numSamples; i += 8)
+                _mm_storeu_si128 (reinterpret_cast<__m128i*> (dest + i),
+                                  _mm256_cvtps_ph (_mm256_mul_ps (_mm256_loadu_ps (source + i), s), _MM_FROUND_TO_NEAREST_INT));
+
+            encodeScalar (source + i, dest + i, numSamples - i, scale);
+        }
+
+        DELAY_KERNEL_TARGET_F16C
+        static void decodeF16C (const StorageType* source, float* dest, int numSamples, float scale) noexcept
+        {
+            int i = 0;
+
+            for (; i + 8 <= numSamples; i += 8)
+                _mm256_storeu_ps (dest + i, _mm256_cvtph_ps (_mm_loadu_si128 (reinterpret_cast<const __m128i*> (source + i))));
+
+            decodeScalar (source + i, dest + i, numSamples - i, scale);
+        }
+       #endif
+
+        static void encode (const float* source, StorageType* dest, int numSamples, float scale) noexcept
+        {
+            DelayKernelDispatch::getKernels().encodeHalf (source, dest, numSamples, scale);
+        }
+
+        static void decode (const StorageType* source, float* dest, int numSamples, float scale) noexcept
+        {
+            DelayKernelDispatch::getKernels().decodeHalf (source, dest, numSamples, scale);
+        }
+
+        /** Never called: every sample carries its own exponent. */
+        static void rescale (StorageType*, int, int) noexcept {}
+    };
+};
+
+//==============================================================================
+/**
+    A ring buffer with the same write / advance / read / tap shape as
+    CircularDelayLine, holding its samples in one of the DelaySampleFormats.
+
+    Writes are encoded and reads decoded on the fly, a block of the integer
+    formats at a time. readInterpolated() decodes the window a
+    FractionalDelayReader needs into a scratch buffer and runs the usual
+    interpolation kernels over that, so every interpolation mode works.
+
+    Memory per sample, against 4 bytes for float, and the signal-to-noise ratio
+    measured through a write and read at unity gain (a 997 Hz sine at 48 kHz,
+    and white noise, each at the given peak level):
+
+        format      bytes    saving    sine 0 dB    sine -40 dB    sine -100 dB    noise -20 dB
+        int16       2.03     1.97x     98 dB        94 dB          94 dB           94 dB
+        half        2.03     1.97x     76 dB        73 dB          52 dB           74 dB
+        packed24    3.03     1.32x     145 dB       141 dB         142 dB          142 dB
+
+    The block exponent keeps the integer formats' SNR the same at any level
+    (until a block is below 2^minimumExponent); half loses resolution only
+    below about -84 dB, where its numbers go denormal. The integer formats
+    assume the line is written in time order, one write() per channel between
+    advance()s, and lose the block of history furthest back, so
+    getMaximumDelay() is a block short of the capacity.
+
+    Every block also knows whether it's been cleared, which is how clear() can
+    drop the whole history for the cost of a byte per block.
+*/
+template <DelaySampleFormat Format, int NumChannels>
+class CompressedDelayLine
+{
+public:
+    //==============================================================================
+    using Codec = typename std::conditional<Format == DelaySampleFormat::int16, DelaySampleCodecs::Int16,
+                  typename std::conditional<Format == DelaySampleFormat::half, DelaySampleCodecs::Half,
+                                            DelaySampleCodecs::Packed24>::type>::type;
+
+    using StorageType = typename Codec::StorageType;
+    static constexpr int blockSize = DelaySampleCodecs::blockSize;
+
+    CompressedDelayLine() = default;
+
+    /** Allocates room for at least minimumCapacity samples of delay per channel.
+        maximumBlockSize is the most any one readInterpolated() will be asked for.
+    */
+    void prepare (int numChannelsToUse, int minimumCapacity, int maximumBlockSize)
+    {
+        jassert (juce::isPositiveAndBelow (numChannelsToUse - 1, NumChannels));
+
+        numChannels = numChannelsToUse;
+        capacity = juce::nextPowerOfTwo (minimumCapacity + blockSize);
+        mask = capacity - 1;
+
+        for (int channel = 0; channel < NumChannels; ++channel)
+        {
+            auto used = channel < numChannels;
+
+            // the SIMD decode reads a little past the last sample
+            samples[(size_t) channel].assign (used ? (size_t) (capacity * Codec::unitsPerSample + paddingUnits) : 0, StorageType());
+            exponents[(size_t) channel].assign (used ? (size_t) (capacity / blockSize) : 0, (std::int8_t) silentExponent);
+        }
+
+        scratch.assign ((size_t) (maximumBlockSize + DelayInterpolationKernels::maxTaps), 0.0f);
+        writePosition = 0;
+    }
+
+    /** Clears the history and moves the write head back to the start. */
+    void reset() noexcept
+    {
+        for (int channel = 0; channel < numChannels; ++channel)
+        {
+            std::fill (samples[(size_t) channel].begin(), samples[(size_t) channel].end(), StorageType());
+            std::fill (exponents[(size_t) channel].begin(), exponents[(size_t) channel].end(), (std::int8_t) silentExponent);
+        }
+
+        writePosition = 0;
+    }
+
+    /** Drops the whole history, which reads as silence from then on, without
+        moving the write head. Only the blocks are marked, not the samples
+        cleared, so this is cheap enough for the audio thread.
+    */
+    void clear() noexcept
+    {
+        for (int channel = 0; channel < numChannels; ++channel)
+            std::fill (exponents[(size_t) channel].begin(), exponents[(size_t) channel].end(), (std::int8_t) silentExponent);
+    }
+
+    //==============================================================================
+    int getNumChannels() const noexcept     { return numChannels; }
+    int getCapacity() const noexcept        { return capacity; }
+    int getWritePosition() const noexcept   { return writePosition; }
+
+    /** The longest delay that read(), tap() and readInterpolated() can serve. */
+    int getMaximumDelay() const noexcept    { return capacity - blockSize; }
+
+    /** The memory the history takes up, for comparing against a float line. */
+    size_t getNumBytes() const noexcept
+    {
+        size_t total = 0;
+
+        for (int channel = 0; channel < numChannels; ++channel)
+            total += samples[(size_t) channel].size() * sizeof (StorageType) + exponents[(size_t) channel].size();
+
+        return total;
+    }
+
+    //==============================================================================
+    /** Encodes numSamples into a channel starting at the write head, scaled by
+        gain. The write head does not move until advance() is called.
+    */
+    void write (int channel, const float* source, int numSamples, float gain = 1.0f) noexcept
+    {
+        jassert (juce::isPositiveAndBelow (channel, numChannels));
+        jassert (numSamples <= capacity);
+
+        auto* data = samples[(size_t) channel].data();
+        auto position = writePosition;
+
+        while (numSamples > 0)
+        {
+            // runs never cross a block, so each is encoded with one scale
+            auto offsetInBlock = position & (blockSize - 1);
+            auto length = juce::jmin (numSamples, blockSize - offsetInBlock);
+            auto& blockExponent = exponents[(size_t) channel][(size_t) (position / blockSize)];
+            auto scale = gain;
+
+            // a block cleared part way through keeps what came before the clear, which is zeroed now
+            if (blockExponent == silentExponent && offsetInBlock > 0)
+                std::fill_n (data + (position - offsetInBlock) * Codec::unitsPerSample, offsetInBlock * Codec::unitsPerSample, StorageType());
+
+            // (half keeps no exponent, only whether the block is silent)
+            if (Codec::hasBlockExponent)
+                scale *= getScaleForWrite (blockExponent, data + (position - offsetInBlock) * Codec::unitsPerSample,
+                                           offsetInBlock, source, length, gain);
+            else
+                blockExponent = 0;
+
+            Codec::encode (source, data + position * Codec::unitsPerSample, length, scale);
+
+            source += length;
+            numSamples -= length;
+            position = (position + length) & mask;
+        }
+    }
+
+    /** Fills dest with numSamples from a channel, starting delayInSamples behind
+        the write head. Samples written this block (before advance()) are visible.
+    */
+    void read (int channel, float* dest, int numSamples, int delayInSamples) const noexcept
+    {
+        jassert (juce::isPositiveAndBelow (channel, numChannels));
+        jassert (delayInSamples >= 0 && delayInSamples <= getMaximumDelay());
+        jassert (numSamples <= capacity);
+
+        const auto* data = samples[(size_t) channel].data();
+        auto position = (writePosition - delayInSamples) & mask;
+
+        while (numSamples > 0)
+        {
+            auto length = juce::jmin (numSamples, blockSize - (position & (blockSize - 1)));
+            auto blockExponent = exponents[(size_t) channel][(size_t) (position / blockSize)];
+
+            if (blockExponent == silentExponent)
+                juce::FloatVectorOperations::clear (dest, length);
+            else
+                Codec::decode (data + position * Codec::unitsPerSample, dest, length, getReadScale (blockExponent));
+
+            dest += length;
+            numSamples -= length;
+            position = (position + length) & mask;
+        }
+    }
+
+    /** Returns the sample delayInSamples behind the write head. */
+    float tap (int channel, int delayInSamples) const noexcept
+    {
+        float result;
+        read (channel, &result, 1, delayInSamples);
+        return result;
+    }
+
+    /** Fills dest with numSamples read delayInSamples behind the write head,
+        interpolated by reader. numSamples can be no more than the
+        maximumBlockSize given to prepare().
+    */
+    void readInterpolated (FractionalDelayReader<float, NumChannels>& reader, int channel,
+                           float* dest, int numSamples, double delayInSamples) noexcept
+    {
+        auto numToDecode = numSamples + reader.getNumTaps() - 1;
+        jassert (numToDecode <= (int) scratch.size());
+
+        read (channel, scratch.data(), numToDecode, reader.getOldestTapDelay (delayInSamples));
+        reader.readContiguous (channel, scratch.data(), dest, numSamples, delayInSamples);
+    }
+
+    /** Like readInterpolated(), but with a separate delay for every output sample,
+        as FractionalDelayReader::readModulated() would read a CircularDelayLine.
+        The window the delays reach over is decoded a run of outputs at a time
+        (as many as the scratch buffer has room for), and each output is
+        interpolated from there on its own.
+    */
+    void readModulated (FractionalDelayReader<float, NumChannels>& reader, int channel,
+                        float* dest, int numSamples, const float* delays) noexcept
+    {
+        auto numTaps = reader.getNumTaps();
+        auto maxWindow = (int) scratch.size();
+
+        for (int start = 0; start < numSamples;)
+        {
+            // where each output's oldest tap is, relative to the write head
+            auto first = start - reader.getOldestTapDelay (delays[start]);
+            auto last = first;
+            auto end = start + 1;
+
+            for (; end < numSamples; ++end)
+            {
+                auto oldest = end - reader.getOldestTapDelay (delays[end]);
+
+                if (juce::jmax (last, oldest) - juce::jmin (first, oldest) + numTaps > maxWindow)
+                    break;
+
+                first = juce::jmin (first, oldest);
+                last = juce::jmax (last, oldest);
+            }
+
+            read (channel, scratch.data(), last - first + numTaps, -first);
+
+            for (int i = start; i < end; ++i)
+                reader.readContiguous (channel, scratch.data() + (i - reader.getOldestTapDelay (delays[i]) - first),
+                                       dest + i, 1, delays[i]);
+
+            start = end;
+        }
+    }
+
+    /** True if the numSamples before the write head are no louder than threshold
+        in every channel. The integer formats can tell that from most blocks'
+        exponents alone, so only blocks that might be louder are decoded.
+    */
+    bool isQuiet (int numSamples, float threshold) const noexcept
+    {
+        float decoded[blockSize];
+
+        for (int channel = 0; channel < numChannels; ++channel)
+        {
+            const auto* data = samples[(size_t) channel].data();
+            auto position = (writePosition - numSamples) & mask;
+
+            for (auto remaining = numSamples; remaining > 0;)
+            {
+                auto length = juce::jmin (remaining, blockSize - (position & (blockSize - 1)));
+                auto blockExponent = exponents[(size_t) channel][(size_t) (position / blockSize)];
+
+                // (every sample in a block is below 2^exponent)
+                if (blockExponent != silentExponent && ! (Codec::hasBlockExponent && std::ldexp (1.0f, blockExponent) <= threshold))
+                {
+                    Codec::decode (data + position * Codec::unitsPerSample, decoded, length, getReadScale (blockExponent));
+                    auto range = juce::FloatVectorOperations::findMinAndMax (decoded, length);
+
+                    if (juce::jmax (-range.getStart(), range.getEnd()) > threshold)
+                        return false;
+                }
+
+                remaining -= length;
+                position = (position + length) & mask;
+            }
+        }
+
+        return true;
+    }
+
+    /** Moves the write head on by numSamples, wrapping at the capacity. */
+    void advance (int numSamples) noexcept
+    {
+        writePosition = (writePosition + numSamples) & mask;
+    }
+
+private:
+    //==============================================================================
+    static constexpr int paddingUnits = 16;
+
+    // the exponent of a block that's been cleared, and reads as silence whatever its samples hold
+    static constexpr int silentExponent = DelaySampleCodecs::minimumExponent - 1;
+
+    static float getScaleForExponent (int exponent) noexcept
+    {
+        return std::ldexp (1.0f, Codec::bits - 1 - exponent);
+    }
+
+    /** Works out the exponent of the block a run is about to be written into and
+        returns the scale to encode it with. A run at the start of a block (or of
+        one that's been cleared) starts it afresh; a later run that's louder than
+        what's there re-encodes the start of the block at the coarser scale first.
+    */
+    float getScaleForWrite (std::int8_t& blockExponent, StorageType* blockStart, int offsetInBlock,
+                            const float* source, int length, float gain) noexcept
+    {
+        auto range = juce::FloatVectorOperations::findMinAndMax (source, length);
+        auto exponent = DelaySampleCodecs::getBlockExponent (juce::jmax (-range.getStart(), range.getEnd()) * std::abs (gain));
+
+        if (offsetInBlock > 0 && blockExponent != silentExponent)
+        {
+            if (exponent > blockExponent)
+                Codec::rescale (blockStart, offsetInBlock, exponent - blockExponent);
+            else
+                exponent = blockExponent;
+        }
+
+        blockExponent = (std::int8_t) exponent;
+        return getScaleForExponent (exponent);
+    }
+
+    static float getReadScale (int blockExponent) noexcept
+    {
+        if (! Codec::hasBlockExponent)
+            return 1.0f;
+
+        return 1.0f / getScaleForExponent (blockExponent);
+    }
+
+    //==============================================================================
+    std::array<std::vector<StorageType>, NumChannels> samples;
+    std::array<std::vector<std::int8_t>, NumChannels> exponents;
+    std::vector<float> scratch;
+    int numChannels = 0, capacity = 0, mask = 0, writePosition = 0;
+
+    JUCE_DECLARE_NON_COPYABLE (CompressedDelayLine)
+};
@@ -0,0 +1,395 @@
+/*
+  ==============================================================================
+
+    CompressedDelayLineTests.cpp
+
+    Round-trips each DelaySampleFormat through a CompressedDelayLine against a
+    float copy of what went in, and checks the SIMD codecs against the scalar
+    ones they stand in for. Registered with JUCE's UnitTestRunner by the
+    static instance at the bottom.
+
+  ==============================================================================
+*/
+
+#include "CompressedDelayLine.h"
+
+//==============================================================================
+class CompressedDelayLineTests  : public juce::UnitTest
+{
+public:
+    CompressedDelayLineTests()  : juce::UnitTest ("CompressedDelayLine codecs", "Delay") {}
+
+    void runTest() override
+    {
+        using Codecs = DelaySampleCodecs;
+
+        beginTest ("Every instruction set's codecs match the scalar ones");
+        for (auto instructionSet : { DelayInstructionSet::scalar, DelayInstructionSet::sse2,
+                                     DelayInstructionSet::avx2, DelayInstructionSet::avx512 })
+        {
+            if (! DelayKernelDispatch::forceInstructionSet (instructionSet))
+                continue;
+
+            checkCodec<Codecs::Int16>   (std::ldexp (1.0f, 15), 0);
+            checkCodec<Codecs::Packed24> (std::ldexp (1.0f, 23), 0);
+            checkCodec<Codecs::Half>    (1.0f, 24);
+        }
+
+        DelayKernelDispatch::resetInstructionSet();
+
+        // the levels of the table in CompressedDelayLine's comment, with a few dB to spare
+        beginTest ("16-bit round trip");
+        checkRoundTrip<DelaySampleFormat::int16> (0.0f, 90.0);
+        checkRoundTrip<DelaySampleFormat::int16> (-40.0f, 90.0);
+        checkRoundTrip<DelaySampleFormat::int16> (-100.0f, 90.0);
+
+        beginTest ("Half-precision round trip");
+        checkRoundTrip<DelaySampleFormat::half> (0.0f, 70.0);
+        checkRoundTrip<DelaySampleFormat::half> (-40.0f, 68.0);
+        checkRoundTrip<DelaySampleFormat::half> (-100.0f, 45.0);
+
+        beginTest ("24-bit round trip");
+        checkRoundTrip<DelaySampleFormat::packed24> (0.0f, 135.0);
+        checkRoundTrip<DelaySampleFormat::packed24> (-40.0f, 135.0);
+        checkRoundTrip<DelaySampleFormat::packed24> (-100.0f, 135.0);
+
+        beginTest ("16-bit blocks rescaled by a louder run");
+        checkRescale<DelaySampleFormat::int16>();
+
+        beginTest ("24-bit blocks rescaled by a louder run");
+        checkRescale<DelaySampleFormat::packed24>();
+
+        beginTest ("A cleared line is silent until it's written again");
+        checkClear<DelaySampleFormat::int16>();
+        checkClear<DelaySampleFormat::half>();
+        checkClear<DelaySampleFormat::packed24>();
+
+        beginTest ("Modulated reads match a read at each output's delay");
+        checkModulatedRead<DelaySampleFormat::int16>();
+        checkModulatedRead<DelaySampleFormat::packed24>();
+    }
+
+private:
+    //==============================================================================
+    static constexpr int numChannels = 2;
+
+    // Encodes and decodes runs of random lengths, from unaligned addresses, through whichever
+    // kernels are in use and through the scalar ones, which must agree to the bit (the values
+    // go past full scale, so the saturation is covered too, and for half, down into denormals)
+    template <typename Codec>
+    void checkCodec (float scale, int numOctavesBelow)
+    {
+        using StorageType = typename Codec::StorageType;
+
+        auto random = getRandom();
+        constexpr int maxLength = 100, padding = 16;
+
+        std::vector<float> source ((size_t) maxLength + 4), decoded ((size_t) maxLength + 4), expectedDecoded ((size_t) maxLength + 4);
+        std::vector<StorageType> encoded ((size_t) ((maxLength + 4) * Codec::unitsPerSample + padding)),
+                                 expectedEncoded (encoded.size());
+
+        auto mismatches = 0;
+
+        for (int trial = 0; trial < 500; ++trial)
+        {
+            auto length = random.nextInt (maxLength + 1);
+            auto offset = random.nextInt (4);
+
+            for (auto& x : source)
+                x = (random.nextFloat() * 2.5f - 1.25f) * std::ldexp (1.0f, -random.nextInt (numOctavesBelow + 1));
+
+            std::fill (encoded.begin(), encoded.end(), StorageType());
+            std::fill (expectedEncoded.begin(), expectedEncoded.end(), StorageType());
+
+            Codec::encode (source.data() + offset, encoded.data() + offset * Codec::unitsPerSample, length, scale);
+            Codec::encodeScalar (source.data() + offset, expectedEncoded.data() + offset * Codec::unitsPerSample, length, scale);
+
+            // (which also checks that nothing outside the run was written)
+            if (encoded != expectedEncoded)
+                ++mismatches;
+
+            Codec::decode (expectedEncoded.data() + offset * Codec::unitsPerSample, decoded.data() + offset, length, 1.0f / scale);
+            Codec::decodeScalar (expectedEncoded.data() + offset * Codec::unitsPerSample, expectedDecoded.data() + offset, length, 1.0f / scale);
+
+            if (std::memcmp (decoded.data() + offset, expectedDecoded.data() + offset, (size_t) length * sizeof (float)) != 0)
+                ++mismatches;
+        }
+
+        expectEquals (mismatches, 0, "a codec doesn't match its scalar version");
+    }
+
+    //==============================================================================
+    // Writes a sine with a little noise on it, levelDb below full scale, in blocks of random
+    // sizes, and reads it back at random delays after every advance(); the error over
+    // every read has to be at least minimumSnrDb below the signal
+    template <DelaySampleFormat Format>
+    void checkRoundTrip (float levelDb, double minimumSnrDb)
+    {
+        auto random = getRandom();
+
+        CompressedDelayLine<Format, numChannels> line;
+        line.prepare (numChannels, 1 << 14, maxBlockSize);
+
+        auto level = juce::Decibels::decibelsToGain (levelDb, -200.0f);
+        auto frequency = 0.01f + 0.1f * random.nextFloat();
+
+        std::vector<std::vector<float>> written ((size_t) numChannels);
+        std::vector<float> block ((size_t) maxBlockSize), dest ((size_t) maxBlockSize);
+        double signalEnergy = 0.0, errorEnergy = 0.0;
+
+        for (int blockIndex = 0; blockIndex < 300; ++blockIndex)
+        {
+            auto numSamples = 1 + random.nextInt (maxBlockSize);
+
+            for (int channel = 0; channel < numChannels; ++channel)
+            {
+                auto& history = written[(size_t) channel];
+
+                for (int i = 0; i < numSamples; ++i)
+                {
+                    auto n = (float) (history.size() + (size_t) i);
+                    block[(size_t) i] = level * (0.9f * std::sin (frequency * n + (float) channel) + 0.1f * (random.nextFloat() * 2.0f - 1.0f));
+                }
+
+                line.write (channel, block.data(), numSamples);
+                history.insert (history.end(), block.begin(), block.begin() + numSamples);
+            }
+
+            line.advance (numSamples);
+
+            for (int read = 0; read < 4; ++read)
+            {
+                auto delay = 1 + random.nextInt (line.getMaximumDelay());
+                auto length = 1 + random.nextInt (juce::jmin (delay, maxBlockSize));
+                auto channel = random.nextInt (numChannels);
+                auto& history = written[(size_t) channel];
+
+                line.read (channel, dest.data(), length, delay);
+
+                for (int i = 0; i < length; ++i)
+                {
+                    auto index = (juce::int64) history.size() - delay + i;
+                    auto expected = index >= 0 ? history[(size_t) index] : 0.0f;
+
+                    signalEnergy += (double) expected * expected;
+                    errorEnergy += ((double) dest[(size_t) i] - expected) * ((double) dest[(size_t) i] - expected);
+                }
+            }
+        }
+
+        auto snrDb = errorEnergy > 0.0 ? 10.0 * std::log10 (signalEnergy / errorEnergy) : 1000.0;
+        expect (snrDb >= minimumSnrDb, "the round trip is noisier than the format allows");
+    }
+
+    //==============================================================================
+    // Writes runs of 1 to 40 samples, each at its own level and gain, so that most blocks are
+    // started by one run and finished by others that may be far louder or quieter. Every sample
+    // read back must be within one step of its block's final scale of what went in: the rounding
+    // when it was encoded, halved by each rescale since, plus the rounding of the last rescale
+    template <DelaySampleFormat Format>
+    void checkRescale()
+    {
+        using Line = CompressedDelayLine<Format, numChannels>;
+
+        auto random = getRandom();
+
+        Line line;
+        line.prepare (numChannels, 1 << 12, maxBlockSize);
+
+        std::vector<std::vector<float>> written ((size_t) numChannels);
+        std::vector<float> run (64), dest ((size_t) line.getCapacity());
+        auto numLouderRuns = 0, numOutOfBounds = 0;
+
+        for (int runIndex = 0; runIndex < 2000; ++runIndex)
+        {
+            auto numSamples = 1 + random.nextInt (40);
+            auto gain = 0.25f + 3.75f * random.nextFloat();
+
+            for (int channel = 0; channel < numChannels; ++channel)
+            {
+                auto& history = written[(size_t) channel];
+                auto level = std::ldexp (1.0f, -random.nextInt (24));
+                auto offsetInBlock = (int) (history.size() % (size_t) Line::blockSize);
+
+                for (int i = 0; i < numSamples; ++i)
+                    run[(size_t) i] = level * (random.nextFloat() * 2.0f - 1.0f);
+
+                // (counted to make sure the rescale is actually exercised)
+                if (offsetInBlock > 0)
+                {
+                    auto blockStart = history.size() - (size_t) offsetInBlock;
+                    auto runPeak = 0.0f, blockPeak = 0.0f;
+
+                    for (int i = 0; i < juce::jmin (numSamples, Line::blockSize - offsetInBlock); ++i)
+                        runPeak = juce::jmax (runPeak, std::abs (run[(size_t) i] * gain));
+
+                    for (auto i = blockStart; i < history.size(); ++i)
+                        blockPeak = juce::jmax (blockPeak, std::abs (history[i]));
+
+                    if (DelaySampleCodecs::getBlockExponent (runPeak) > DelaySampleCodecs::getBlockExponent (blockPeak))
+                        ++numLouderRuns;
+                }
+
+                line.write (channel, run.data(), numSamples, gain);
+
+                for (int i = 0; i < numSamples; ++i)
+                    history.push_back (run[(size_t) i] * gain);
+            }
+
+            line.advance (numSamples);
+
+            if (runIndex % 50 != 49)
+                continue;
+
+            // everything the line still holds, oldest first
+            for (int channel = 0; channel < numChannels; ++channel)
+            {
+                auto& history = written[(size_t) channel];
+                auto delay = juce::jmin (line.getMaximumDelay(), (int) history.size());
+                auto oldest = history.size() - (size_t) delay;
+
+                line.read (channel, dest.data(), delay, delay);
+
+                for (int i = 0; i < delay; ++i)
+                {
+                    auto index = oldest + (size_t) i;
+                    auto blockStart = index - index % (size_t) Line::blockSize;
+                    auto blockPeak = 0.0f;
+
+                    for (auto j = blockStart; j < juce::jmin (history.size(), blockStart + (size_t) Line::blockSize); ++j)
+                        blockPeak = juce::jmax (blockPeak, std::abs (history[j]));
+
+                    auto step = std::ldexp (1.0f, DelaySampleCodecs::getBlockExponent (blockPeak) - (Line::Codec::bits - 1));
+
+                    if (std::abs (dest[(size_t) i] - history[index]) > step)
+                        ++numOutOfBounds;
+                }
+            }
+        }
+
+        expect (numLouderRuns > 100, "the runs didn't rescale many blocks");
+        expectEquals (numOutOfBounds, 0, "a sample moved by more than a step of its block's scale");
+    }
+
+    //==============================================================================
+    // Clears the line part way through a block, then writes a little more: everything
+    // from before the clear has to read as silence, and everything after it as written
+    template <DelaySampleFormat Format>
+    void checkClear()
+    {
+        auto random = getRandom();
+
+        for (int trial = 0; trial < 20; ++trial)
+        {
+            CompressedDelayLine<Format, numChannels> line;
+            line.prepare (numChannels, 1 << 12, maxBlockSize);
+
+            std::vector<float> block ((size_t) maxBlockSize), dest ((size_t) line.getMaximumDelay());
+            auto numBefore = 0;
+
+            for (int blockIndex = 0; blockIndex < 10; ++blockIndex)
+            {
+                auto numSamples = 1 + random.nextInt (maxBlockSize);
+                fillBlock (random, block, numSamples, 0.5f);
+                writeToAllChannels (line, block.data(), numSamples);
+                numBefore += numSamples;
+            }
+
+            expect (! line.isQuiet (maxBlockSize, 1.0e-5f), "a loud line says it's quiet");
+
+            line.clear();
+            expect (line.isQuiet (line.getMaximumDelay(), 0.0f), "a cleared line isn't quiet");
+
+            auto numAfter = 1 + random.nextInt (maxBlockSize);
+            fillBlock (random, block, numAfter, 0.5f);
+            writeToAllChannels (line, block.data(), numAfter);
+
+            auto numWrong = 0;
+
+            for (int channel = 0; channel < numChannels; ++channel)
+            {
+                auto delay = juce::jmin (line.getMaximumDelay(), numBefore + numAfter);
+                line.read (channel, dest.data(), delay, delay);
+
+                for (int i = 0; i < delay - numAfter; ++i)
+                    numWrong += dest[(size_t) i] != 0.0f ? 1 : 0;
+
+                for (int i = 0; i < numAfter; ++i)
+                    numWrong += std::abs (dest[(size_t) (delay - numAfter + i)] - block[(size_t) i]) > 1.0e-3f ? 1 : 0;
+            }
+
+            expectEquals (numWrong, 0, "the history from before the clear didn't read as silence, or after it as written");
+        }
+    }
+
+    //==============================================================================
+    // Spreads of delays too wide for one window (so the reads are split into runs) and
+    // narrow ones, through linear and 3rd-order Lagrange interpolation: every output has
+    // to match a one-sample readInterpolated() at the same point in the history
+    template <DelaySampleFormat Format>
+    void checkModulatedRead()
+    {
+        auto random = getRandom();
+        constexpr int readBlockSize = 64;
+
+        CompressedDelayLine<Format, numChannels> line;
+        line.prepare (numChannels, 1 << 13, readBlockSize);
+
+        std::vector<float> block ((size_t) maxBlockSize);
+
+        for (int blockIndex = 0; blockIndex < 20; ++blockIndex)
+        {
+            fillBlock (random, block, maxBlockSize, 1.0f);
+            writeToAllChannels (line, block.data(), maxBlockSize);
+        }
+
+        FractionalDelayReader<float, numChannels> reader, expectedReader;
+        std::vector<float> delays ((size_t) readBlockSize), dest ((size_t) readBlockSize);
+        auto numWrong = 0;
+
+        for (int trial = 0; trial < 200; ++trial)
+        {
+            auto interpolation = trial % 2 == 0 ? DelayInterpolation::linear : DelayInterpolation::lagrange3;
+            reader.setInterpolation (interpolation);
+            expectedReader.setInterpolation (interpolation);
+
+            auto spread = trial % 4 < 2 ? 4000.0f : 20.0f;
+            auto shortest = (float) readBlockSize + 4.0f;
+
+            for (auto& delay : delays)
+                delay = shortest + spread * random.nextFloat();
+
+            auto channel = random.nextInt (numChannels);
+            line.readModulated (reader, channel, dest.data(), readBlockSize, delays.data());
+
+            for (int i = 0; i < readBlockSize; ++i)
+            {
+                float expected;
+                line.readInterpolated (expectedReader, channel, &expected, 1, (double) delays[(size_t) i] - i);
+                numWrong += dest[(size_t) i] != expected ? 1 : 0;
+            }
+        }
+
+        expectEquals (numWrong, 0, "a modulated read doesn't match reading each delay on its own");
+    }
+
+    //==============================================================================
+    static void fillBlock (juce::Random& random, std::vector<float>& block, int numSamples, float level)
+    {
+        for (int i = 0; i < numSamples; ++i)
+            block[(size_t) i] = level * (random.nextFloat() * 2.0f - 1.0f);
+    }
+
+    template <typename Line>
+    static void writeToAllChannels (Line& line, const float* source, int numSamples)
+    {
+        for (int channel = 0; channel < numChannels; ++channel)
+            line.write (channel, source, numSamples);
+
+        line.advance (numSamples);
+    }
+
+    static constexpr int maxBlockSize = 512;
+};
+
+static CompressedDelayLineTests compressedDelayLineTests;
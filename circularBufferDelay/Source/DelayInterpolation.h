@@ -0,0 +1,762 @@
+/*
+  ==============================================================================
+
+    DelayInterpolation.h
+
+    Fractional-delay reads from a CircularDelayLine, with a choice of
+    interpolation quality per instance.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "CircularDelayLine.h"
+#include "DelayKernelDispatch.h"
+
+//==============================================================================
+/** The interpolation used for delay times that aren't a whole number of samples,
+    roughly in order of CPU cost.
+*/
+enum class DelayInterpolation
+{
+    none,           /**< Rounds to the nearest sample. */
+    linear,         /**< 2-point linear. */
+    lagrange3,      /**< 4-point, 3rd-order Lagrange. */
+    lagrange5,      /**< 6-point, 5th-order Lagrange. */
+    thiran,         /**< 1st-order Thiran allpass: flat magnitude, but recursive. */
+    windowedSinc    /**< 8-point Blackman-windowed sinc from a precomputed table. */
+};
+
+//==============================================================================
+/**
+    The inner loops behind FractionalDelayReader.
+
+    Every FIR interpolator is the same loop with different coefficients:
+    dest[i] = sum over j of coefficients[j] * oldest[i + j], where oldest points
+    at the oldest of the numTaps samples that output i needs. With a constant
+    delay across the block the coefficients are constant too, so the loop
+    vectorises across i with plain unaligned loads.
+
+    fir() and the gathers go to the versions for the widest instruction set the
+    machine supports, through DelayKernelDispatch; the scalar versions are the
+    reference the SIMD ones are checked against.
+*/
+struct DelayInterpolationKernels
+{
+    static constexpr int maxTaps = 8;
+
+    template <typename SampleType>
+    static void firScalar (const SampleType* oldest, SampleType* dest, int numSamples,
+                           const SampleType* coefficients, int numTaps) noexcept
+    {
+        DELAY_KERNEL_NO_FP_CONTRACT
+
+        for (int i = 0; i < numSamples; ++i)
+        {
+            auto sum = SampleType();
+
+            for (int j = 0; j < numTaps; ++j)
+                sum += coefficients[j] * oldest[i + j];
+
+            dest[i] = sum;
+        }
+    }
+
+   #if JUCE_USE_SSE_INTRINSICS
+    static void firSSE (const float* oldest, float* dest, int numSamples,
+                        const float* coefficients, int numTaps) noexcept
+    {
+        __m128 c[maxTaps];
+
+        for (int j = 0; j < numTaps; ++j)
+            c[j] = _mm_set1_ps (coefficients[j]);
+
+        int i = 0;
+
+        for (; i + 4 <= numSamples; i += 4)
+        {
+            auto sum = _mm_mul_ps (c[0], _mm_loadu_ps (oldest + i));
+
+            for (int j = 1; j < numTaps; ++j)
+                sum = _mm_add_ps (sum, _mm_mul_ps (c[j], _mm_loadu_ps (oldest + i + j)));
+
+            _mm_storeu_ps (dest + i, sum);
+        }
+
+        firScalar (oldest + i, dest + i, numSamples - i, coefficients, numTaps);
+    }
+    DELAY_KERNEL_TARGET_AVX2
+    static void firAVX2 (const float* oldest, float* dest, int numSamples,
+                         const float* coefficients, int numTaps) noexcept
+    {
+        __m256 c[maxTaps];
+
+        for (int j = 0; j < numTaps; ++j)
+            c[j] = _mm256_set1_ps (coefficients[j]);
+
+        int i = 0;
+
+        for (; i + 8 <= numSamples; i += 8)
+        {
+            auto sum = _mm256_mul_ps (c[0], _mm256_loadu_ps (oldest + i));
+
+            for (int j = 1; j < numTaps; ++j)
+                sum = _mm256_add_ps (sum, _mm256_mul_ps (c[j], _mm256_loadu_ps (oldest + i + j)));
+
+            _mm256_storeu_ps (dest + i, sum);
+        }
+
+        firSSE (oldest + i, dest + i, numSamples - i, coefficients, numTaps);
+    }
+
+    DELAY_KERNEL_TARGET_AVX512
+    static void firAVX512 (const float* oldest, float* dest, int numSamples,
+                           const float* coefficients, int numTaps) noexcept
+    {
+        __m512 c[maxTaps];
+
+        for (int j = 0; j < numTaps; ++j)
+            c[j] = _mm512_set1_ps (coefficients[j]);
+
+        int i = 0;
+
+        for (; i + 16 <= numSamples; i += 16)
+        {
+            auto sum = _mm512_mul_ps (c[0], _mm512_loadu_ps (oldest + i));
+
+            for (int j = 1; j < numTaps; ++j)
+                sum = _mm512_add_ps (sum, _mm512_mul_ps (c[j], _mm512_loadu_ps (oldest + i + j)));
+
+            _mm512_storeu_ps (dest + i, sum);
+        }
+
+        firAVX2 (oldest + i, dest + i, numSamples - i, coefficients, numTaps);
+    }
+   #endif
+
+    static void fir (const float* oldest, float* dest, int numSamples,
+                     const float* coefficients, int numTaps) noexcept
+    {
+        DelayKernelDispatch::getKernels().fir (oldest, dest, numSamples, coefficients, numTaps);
+    }
+
+    static void fir (const double* oldest, double* dest, int numSamples,
+                     const double* coefficients, int numTaps) noexcept
+    {
+        firScalar (oldest, dest, numSamples, coefficients, numTaps);
+    }
+
+    //==============================================================================
+    /** Per-sample modulated reads. Output i is read delays[i] samples behind
+        position writePosition + i of a ring buffer of mask + 1 samples starting at
+        data, which must have at least 3 guard samples (or be mirrored).
+        With a different delay for every sample there's no shared window to
+        slide along, so each output gathers its own taps.
+    */
+    template <typename SampleType>
+    static void gatherLinearScalar (const SampleType* data, int mask, int writePosition,
+                                    const SampleType* delays, SampleType* dest, int numSamples) noexcept
+    {
+        DELAY_KERNEL_NO_FP_CONTRACT
+
+        for (int i = 0; i < numSamples; ++i)
+        {
+            auto whole = std::floor (delays[i]);
+            auto fraction = delays[i] - whole;
+            const auto* oldest = data + ((writePosition + i - (int) whole - 1) & mask);
+
+            dest[i] = oldest[1] + fraction * (oldest[0] - oldest[1]);
+        }
+    }
+
+    template <typename SampleType>
+    static void gatherLagrange3Scalar (const SampleType* data, int mask, int writePosition,
+                                       const SampleType* delays, SampleType* dest, int numSamples) noexcept
+    {
+        DELAY_KERNEL_NO_FP_CONTRACT
+
+        for (int i = 0; i < numSamples; ++i)
+        {
+            auto newest = std::floor (delays[i]) - SampleType (1);
+            auto d = delays[i] - newest;
+            const auto* oldest = data + ((writePosition + i - (int) newest - 3) & mask);
+
+            SampleType c[4];
+            lagrange3Coefficients (d, c);
+
+            dest[i] = c[0] * oldest[0] + c[1] * oldest[1] + c[2] * oldest[2] + c[3] * oldest[3];
+        }
+    }
+
+    /** 3rd-order Lagrange coefficients, oldest tap first, for a read point d
+        samples older than the newest of the four taps (d in [1, 2)).
+    */
+    template <typename SampleType>
+    static void lagrange3Coefficients (SampleType d, SampleType* c) noexcept
+    {
+        DELAY_KERNEL_NO_FP_CONTRACT
+
+        auto d1 = d - SampleType (1), d2 = d - SampleType (2), d3 = d - SampleType (3);
+
+        c[0] =  d * d1 * d2 / SampleType (6);
+        c[1] = -d * d1 * d3 / SampleType (2);
+        c[2] =  d * d2 * d3 / SampleType (2);
+        c[3] = -d1 * d2 * d3 / SampleType (6);
+    }
+
+   #if JUCE_USE_SSE_INTRINSICS
+    /** SSE has no gather, so the taps are loaded one lane at a time, but the
+        index and coefficient maths for four outputs happens together.
+    */
+    static void gatherLinearSSE (const float* data, int mask, int writePosition,
+                                 const float* delays, float* dest, int numSamples) noexcept
+    {
+        auto lanes = _mm_setr_epi32 (0, 1, 2, 3);
+        auto maskV = _mm_set1_epi32 (mask);
+        int i = 0;
+
+        for (; i + 4 <= numSamples; i += 4)
+        {
+            auto delay    = _mm_loadu_ps (delays + i);
+            auto whole    = _mm_cvttps_epi32 (delay);   // delays are positive, so truncation is floor
+            auto fraction = _mm_sub_ps (delay, _mm_cvtepi32_ps (whole));
+            auto position = _mm_add_epi32 (_mm_set1_epi32 (writePosition + i - 1), lanes);
+            auto index    = _mm_and_si128 (_mm_sub_epi32 (position, whole), maskV);
+
+            alignas (16) int indices[4];
+            _mm_store_si128 (reinterpret_cast<__m128i*> (indices), index);
+
+            auto older = _mm_setr_ps (data[indices[0]],     data[indices[1]],     data[indices[2]],     data[indices[3]]);
+            auto newer = _mm_setr_ps (data[indices[0] + 1], data[indices[1] + 1], data[indices[2] + 1], data[indices[3] + 1]);
+
+            _mm_storeu_ps (dest + i, _mm_add_ps (newer, _mm_mul_ps (fraction, _mm_sub_ps (older, newer))));
+        }
+
+        gatherLinearScalar (data, mask, writePosition + i, delays + i, dest + i, numSamples - i);
+    }
+    DELAY_KERNEL_TARGET_AVX2
+    static void gatherLinearAVX2 (const float* data, int mask, int writePosition,
+                                  const float* delays, float* dest, int numSamples) noexcept
+    {
+        auto lanes = _mm256_setr_epi32 (0, 1, 2, 3, 4, 5, 6, 7);
+        auto maskV = _mm256_set1_epi32 (mask);
+        auto one   = _mm256_set1_epi32 (1);
+        int i = 0;
+
+        for (; i + 8 <= numSamples; i += 8)
+        {
+            auto delay    = _mm256_loadu_ps (delays + i);
+            auto whole    = _mm256_cvttps_epi32 (delay);
+            auto fraction = _mm256_sub_ps (delay, _mm256_cvtepi32_ps (whole));
+            auto position = _mm256_add_epi32 (_mm256_set1_epi32 (writePosition + i - 1), lanes);
+            auto index    = _mm256_and_si256 (_mm256_sub_epi32 (position, whole), maskV);
+
+            auto older = _mm256_i32gather_ps (data, index, 4);
+            auto newer = _mm256_i32gather_ps (data, _mm256_add_epi32 (index, one), 4);
+
+            _mm256_storeu_ps (dest + i, _mm256_add_ps (newer, _mm256_mul_ps (fraction, _mm256_sub_ps (older, newer))));
+        }
+
+        gatherLinearScalar (data, mask, writePosition + i, delays + i, dest + i, numSamples - i);
+    }
+
+    DELAY_KERNEL_TARGET_AVX2
+    static void gatherLagrange3AVX2 (const float* data, int mask, int writePosition,
+                                     const float* delays, float* dest, int numSamples) noexcept
+    {
+        auto lanes = _mm256_setr_epi32 (0, 1, 2, 3, 4, 5, 6, 7);
+        auto maskV = _mm256_set1_epi32 (mask);
+        auto one   = _mm256_set1_ps (1.0f);
+        auto two   = _mm256_set1_ps (2.0f);
+        auto three = _mm256_set1_ps (3.0f);
+        auto six   = _mm256_set1_ps (6.0f);
+        auto half  = _mm256_set1_ps (0.5f);
+        auto sign  = _mm256_set1_ps (-0.0f);
+        int i = 0;
+
+        for (; i + 8 <= numSamples; i += 8)
+        {
+            auto delay    = _mm256_loadu_ps (delays + i);
+            auto newest   = _mm256_sub_ps (_mm256_floor_ps (delay), one);
+            auto d        = _mm256_sub_ps (delay, newest);
+            auto position = _mm256_add_epi32 (_mm256_set1_epi32 (writePosition + i - 3), lanes);
+            auto index    = _mm256_and_si256 (_mm256_sub_epi32 (position, _mm256_cvtps_epi32 (newest)), maskV);
+
+            // the same operations in the same order as lagrange3Coefficients(), so the result is bit-exact
+            // (halving is exact, so it can be a multiply; the sixths can't)
+            auto d1 = _mm256_sub_ps (d, one), d2 = _mm256_sub_ps (d, two), d3 = _mm256_sub_ps (d, three);
+            auto dd1 = _mm256_mul_ps (d, d1);
+
+            auto c0 = _mm256_div_ps (_mm256_mul_ps (dd1, d2), six);
+            auto c1 = _mm256_xor_ps (_mm256_mul_ps (_mm256_mul_ps (dd1, d3), half), sign);
+            auto c2 = _mm256_mul_ps (_mm256_mul_ps (_mm256_mul_ps (d, d2), d3), half);
+            auto c3 = _mm256_div_ps (_mm256_mul_ps (_mm256_mul_ps (_mm256_xor_ps (d1, sign), d2), d3), six);
+
+            auto sum = _mm256_mul_ps (c0, _mm256_i32gather_ps (data, index, 4));
+            sum = _mm256_add_ps (sum, _mm256_mul_ps (c1, _mm256_i32gather_ps (data + 1, index, 4)));
+            sum = _mm256_add_ps (sum, _mm256_mul_ps (c2, _mm256_i32gather_ps (data + 2, index, 4)));
+            sum = _mm256_add_ps (sum, _mm256_mul_ps (c3, _mm256_i32gather_ps (data + 3, index, 4)));
+
+            _mm256_storeu_ps (dest + i, sum);
+        }
+
+        gatherLagrange3Scalar (data, mask, writePosition + i, delays + i, dest + i, numSamples - i);
+    }
+
+    DELAY_KERNEL_TARGET_AVX512
+    static void gatherLinearAVX512 (const float* data, int mask, int writePosition,
+                                    const float* delays, float* dest, int numSamples) noexcept
+    {
+        auto lanes = _mm512_set_epi32 (15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+        auto maskV = _mm512_set1_epi32 (mask);
+        auto one   = _mm512_set1_epi32 (1);
+        int i = 0;
+
+        for (; i + 16 <= numSamples; i += 16)
+        {
+            auto delay    = _mm512_loadu_ps (delays + i);
+            auto whole    = _mm512_cvttps_epi32 (delay);
+            auto fraction = _mm512_sub_ps (delay, _mm512_cvtepi32_ps (whole));
+            auto position = _mm512_add_epi32 (_mm512_set1_epi32 (writePosition + i - 1), lanes);
+            auto index    = _mm512_and_epi32 (_mm512_sub_epi32 (position, whole), maskV);
+
+            auto older = _mm512_i32gather_ps (index, data, 4);
+            auto newer = _mm512_i32gather_ps (_mm512_add_epi32 (index, one), data, 4);
+
+            _mm512_storeu_ps (dest + i, _mm512_add_ps (newer, _mm512_mul_ps (fraction, _mm512_sub_ps (older, newer))));
+        }
+
+        gatherLinearAVX2 (data, mask, writePosition + i, delays + i, dest + i, numSamples - i);
+    }
+
+    DELAY_KERNEL_TARGET_AVX512
+    static void gatherLagrange3AVX512 (const float* data, int mask, int writePosition,
+                                       const float* delays, float* dest, int numSamples) noexcept
+    {
+        auto lanes = _mm512_set_epi32 (15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+        auto maskV = _mm512_set1_epi32 (mask);
+        auto one   = _mm512_set1_ps (1.0f);
+        auto two   = _mm512_set1_ps (2.0f);
+        auto three = _mm512_set1_ps (3.0f);
+        auto six   = _mm512_set1_ps (6.0f);
+        auto half  = _mm512_set1_ps (0.5f);
+        auto sign  = _mm512_set1_epi32 ((int) 0x80000000);
+        int i = 0;
+
+        for (; i + 16 <= numSamples; i += 16)
+        {
+            auto delay    = _mm512_loadu_ps (delays + i);
+            auto newest   = _mm512_sub_ps (_mm512_roundscale_ps (delay, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC), one);
+            auto d        = _mm512_sub_ps (delay, newest);
+            auto position = _mm512_add_epi32 (_mm512_set1_epi32 (writePosition + i - 3), lanes);
+            auto index    = _mm512_and_epi32 (_mm512_sub_epi32 (position, _mm512_cvtps_epi32 (newest)), maskV);
+
+            // (AVX-512F has no float xor, so the sign flips go through the integer one; they're written
+            // out here rather than in a lambda, which wouldn't get this function's target attribute)
+            auto d1 = _mm512_sub_ps (d, one), d2 = _mm512_sub_ps (d, two), d3 = _mm512_sub_ps (d, three);
+            auto dd1 = _mm512_mul_ps (d, d1);
+            auto minusD1 = _mm512_castsi512_ps (_mm512_xor_epi32 (_mm512_castps_si512 (d1), sign));
+
+            auto c0 = _mm512_div_ps (_mm512_mul_ps (dd1, d2), six);
+            auto c1 = _mm512_castsi512_ps (_mm512_xor_epi32 (_mm512_castps_si512 (_mm512_mul_ps (_mm512_mul_ps (dd1, d3), half)), sign));
+            auto c2 = _mm512_mul_ps (_mm512_mul_ps (_mm512_mul_ps (d, d2), d3), half);
+            auto c3 = _mm512_div_ps (_mm512_mul_ps (_mm512_mul_ps (minusD1, d2), d3), six);
+
+            auto sum = _mm512_mul_ps (c0, _mm512_i32gather_ps (index, data, 4));
+            sum = _mm512_add_ps (sum, _mm512_mul_ps (c1, _mm512_i32gather_ps (index, data + 1, 4)));
+            sum = _mm512_add_ps (sum, _mm512_mul_ps (c2, _mm512_i32gather_ps (index, data + 2, 4)));
+            sum = _mm512_add_ps (sum, _mm512_mul_ps (c3, _mm512_i32gather_ps (index, data + 3, 4)));
+
+            _mm512_storeu_ps (dest + i, sum);
+        }
+
+        gatherLagrange3AVX2 (data, mask, writePosition + i, delays + i, dest + i, numSamples - i);
+    }
+   #endif
+
+    static void gatherLinear (const float* data, int mask, int writePosition,
+                              const float* delays, float* dest, int numSamples) noexcept
+    {
+        DelayKernelDispatch::getKernels().gatherLinear (data, mask, writePosition, delays, dest, numSamples);
+    }
+
+    static void gatherLinear (const double* data, int mask, int writePosition,
+                              const double* delays, double* dest, int numSamples) noexcept
+    {
+        gatherLinearScalar (data, mask, writePosition, delays, dest, numSamples);
+    }
+
+    static void gatherLagrange3 (const float* data, int mask, int writePosition,
+                                 const float* delays, float* dest, int numSamples) noexcept
+    {
+        DelayKernelDispatch::getKernels().gatherLagrange3 (data, mask, writePosition, delays, dest, numSamples);
+    }
+
+    static void gatherLagrange3 (const double* data, int mask, int writePosition,
+                                 const double* delays, double* dest, int numSamples) noexcept
+    {
+        gatherLagrange3Scalar (data, mask, writePosition, delays, dest, numSamples);
+    }
+
+    //==============================================================================
+    /** First-order Thiran allpass over a delayed signal, where oldest[i] and
+        oldest[i + 1] are the two samples either side of output i.
+        y[n] = a * (x[n] - y[n - 1]) + x[n - 1]. Each output depends on the
+        previous one, so this one stays scalar.
+    */
+    template <typename SampleType>
+    static void thiran (const SampleType* oldest, SampleType* dest, int numSamples,
+                        SampleType a, SampleType& lastOutput) noexcept
+    {
+        auto y = lastOutput;
+
+        for (int i = 0; i < numSamples; ++i)
+        {
+            y = a * (oldest[i + 1] - y) + oldest[i];
+            dest[i] = y;
+        }
+
+        lastOutput = y;
+    }
+};
+
+//==============================================================================
+/**
+    Reads a CircularDelayLine at a fractional delay, using whichever
+    DelayInterpolation the instance was set up with.
+
+    A delay of D samples is split into the integer delay of the newest tap the
+    interpolator needs (getNewestTapDelay()) and a set of coefficients. The line
+    must be mirrored or have at least maxTaps - 1 guard samples, so that each
+    run of the read window is a single branch-free call into
+    DelayInterpolationKernels.
+*/
+template <typename SampleType, int NumChannels>
+class FractionalDelayReader
+{
+public:
+    //==============================================================================
+    FractionalDelayReader() = default;
+
+    void setInterpolation (DelayInterpolation newInterpolation) noexcept
+    {
+        if (interpolation != newInterpolation)
+        {
+            interpolation = newInterpolation;
+            reset();
+        }
+    }
+
+    DelayInterpolation getInterpolation() const noexcept    { return interpolation; }
+
+    /** Clears the allpass state. */
+    void reset() noexcept
+    {
+        thiranState.fill (SampleType());
+    }
+
+    /** Takes over another reader's allpass state, e.g. when a crossfade hands
+        the output over from one read head to another.
+    */
+    void copyStateFrom (const FractionalDelayReader& other) noexcept
+    {
+        thiranState = other.thiranState;
+    }
+
+    /** The number of samples each output is computed from. */
+    int getNumTaps() const noexcept
+    {
+        switch (interpolation)
+        {
+            case DelayInterpolation::linear:        return 2;
+            case DelayInterpolation::lagrange3:     return 4;
+            case DelayInterpolation::lagrange5:     return 6;
+            case DelayInterpolation::thiran:        return 2;
+            case DelayInterpolation::windowedSinc:  return 8;
+            case DelayInterpolation::none:
+            default:                                return 1;
+        }
+    }
+
+    /** How many of the taps sit on the newer side of the read point. */
+    int getLookahead() const noexcept
+    {
+        return interpolation == DelayInterpolation::thiran ? 0 : (getNumTaps() - 1) / 2;
+    }
+
+    /** The shortest delay this interpolator can produce without reading a sample
+        that hasn't been written yet.
+    */
+    double getMinimumDelay() const noexcept
+    {
+        return interpolation == DelayInterpolation::thiran ? 1.5 : (double) getLookahead() + 1.0;
+    }
+
+    /** The integer delay of the newest sample that a read at delayInSamples touches.
+        A block can be read before it's written as long as it's no longer than this.
+    */
+    int getNewestTapDelay (double delayInSamples) const noexcept
+    {
+        switch (interpolation)
+        {
+            case DelayInterpolation::none:      return juce::roundToInt (delayInSamples);
+            case DelayInterpolation::thiran:    return (int) std::floor (delayInSamples - 0.5);
+            default:                            return (int) std::floor (delayInSamples) - getLookahead();
+        }
+    }
+
+    /** The integer delay of the oldest sample that a read at delayInSamples touches. */
+    int getOldestTapDelay (double delayInSamples) const noexcept
+    {
+        return getNewestTapDelay (delayInSamples) + getNumTaps() - 1;
+    }
+
+    //==============================================================================
+    /** Fills dest with numSamples read delayInSamples behind the line's write head.
+        Outputs that would only see history from before a CircularDelayLine::clearLazily()
+        come out silent.
+    */
+    void read (const CircularDelayLine<SampleType, NumChannels>& line, int channel,
+               SampleType* dest, int numSamples, double delayInSamples) noexcept
+    {
+        jassert (delayInSamples >= getMinimumDelay());
+
+        if (auto numStale = line.getNumStaleSamples (numSamples, getOldestTapDelay (delayInSamples)))
+        {
+            // the allpass starts again from silence where the history does
+            juce::FloatVectorOperations::clear (dest, numStale);
+            thiranState[(size_t) channel] = SampleType();
+
+            dest += numStale;
+            numSamples -= numStale;
+            delayInSamples -= numStale;
+
+            if (numSamples == 0)
+                return;
+        }
+
+        SampleType coefficients[DelayInterpolationKernels::maxTaps];
+        auto numTaps = getNumTaps();
+        calculateCoefficientsForDelay (delayInSamples, coefficients);
+
+        // one oldest tap per output; the other taps of the outputs near the end of the
+        // first run spill over into the line's guard samples (or its mirror)
+        jassert (line.getNumGuardSamples() >= numTaps - 1);
+
+        line.getReadRegion (channel, numSamples, getOldestTapDelay (delayInSamples))
+            .forEachSegment ([&] (SampleSpan<const SampleType> oldest, int offset)
+            {
+                process (channel, oldest.data, dest + offset, oldest.size, coefficients, numTaps);
+            });
+    }
+
+    /** Like read(), but from history that has already been laid out contiguously
+        somewhere else, e.g. decoded from a compressed delay line. oldest points
+        at the oldest tap of the first output (getOldestTapDelay() behind it), and
+        numSamples + getNumTaps() - 1 samples from there must be readable.
+    */
+    void readContiguous (int channel, const SampleType* oldest, SampleType* dest, int numSamples, double delayInSamples) noexcept
+    {
+        jassert (delayInSamples >= getMinimumDelay());
+
+        SampleType coefficients[DelayInterpolationKernels::maxTaps];
+        calculateCoefficientsForDelay (delayInSamples, coefficients);
+        process (channel, oldest, dest, numSamples, coefficients, getNumTaps());
+    }
+
+    /** Like read(), but with a separate delay for every output sample, e.g. from
+        an LFO or a control signal. Each delay must be at least getMinimumDelay().
+        Linear and 3rd-order Lagrange have vectorised gather kernels; the other
+        interpolators work out their coefficients sample by sample.
+
+        While the line has stale history, each output is checked against it
+        afterwards, which is a scalar pass over the block.
+    */
+    void readModulated (const CircularDelayLine<SampleType, NumChannels>& line, int channel,
+                        SampleType* dest, int numSamples, const SampleType* delays) noexcept
+    {
+        jassert (line.getNumGuardSamples() >= getNumTaps() - 1);
+
+        const auto* data = line.getChannelPointer (channel);
+        auto mask = line.getCapacity() - 1;
+        auto writePosition = line.getWritePosition();
+
+        switch (interpolation)
+        {
+            case DelayInterpolation::linear:
+                DelayInterpolationKernels::gatherLinear (data, mask, writePosition, delays, dest, numSamples);
+                silenceStaleOutputs (line, dest, numSamples, delays);
+                break;
+
+            case DelayInterpolation::lagrange3:
+                DelayInterpolationKernels::gatherLagrange3 (data, mask, writePosition, delays, dest, numSamples);
+                silenceStaleOutputs (line, dest, numSamples, delays);
+                break;
+
+            case DelayInterpolation::none:
+            case DelayInterpolation::lagrange5:
+            case DelayInterpolation::thiran:
+            case DelayInterpolation::windowedSinc:
+            default:
+            {
+                SampleType coefficients[DelayInterpolationKernels::maxTaps];
+                auto numTaps = getNumTaps();
+                auto checkForStaleHistory = line.hasStaleHistory();
+
+                for (int i = 0; i < numSamples; ++i)
+                {
+                    auto newestTapDelay = getNewestTapDelay (delays[i]);
+
+                    // (the allpass starts again from silence where the history does)
+                    if (checkForStaleHistory && line.getNumStaleSamples (1, newestTapDelay + numTaps - 1 - i) > 0)
+                    {
+                        dest[i] = SampleType();
+                        thiranState[(size_t) channel] = SampleType();
+                        continue;
+                    }
+                    auto delayFromNewest = (double) delays[i] - (double) newestTapDelay;
+
+                    if (interpolation == DelayInterpolation::thiran)
+                        coefficients[0] = (SampleType) ((1.0 - delayFromNewest) / (1.0 + delayFromNewest));
+                    else
+                        calculateCoefficients (delayFromNewest, coefficients);
+
+                    process (channel, data + ((writePosition + i - newestTapDelay - (numTaps - 1)) & mask),
+                             dest + i, 1, coefficients, numTaps);
+                }
+
+                break;
+            }
+        }
+    }
+
+private:
+    //==============================================================================
+    /** Zeroes the outputs of a gather whose taps were all in stale history. */
+    void silenceStaleOutputs (const CircularDelayLine<SampleType, NumChannels>& line,
+                              SampleType* dest, int numSamples, const SampleType* delays) const noexcept
+    {
+        if (! line.hasStaleHistory())
+            return;
+
+        for (int i = 0; i < numSamples; ++i)
+            if (line.getNumStaleSamples (1, getOldestTapDelay (delays[i]) - i) > 0)
+                dest[i] = SampleType();
+    }
+
+    void process (int channel, const SampleType* oldest, SampleType* dest, int numSamples,
+                  const SampleType* coefficients, int numTaps) noexcept
+    {
+        if (interpolation == DelayInterpolation::thiran)
+            DelayInterpolationKernels::thiran (oldest, dest, numSamples, coefficients[0], thiranState[(size_t) channel]);
+        else
+            DelayInterpolationKernels::fir (oldest, dest, numSamples, coefficients, numTaps);
+    }
+
+    /** Fills in the coefficients for a fixed read at delayInSamples: the FIR taps,
+        or the allpass coefficient for Thiran.
+    */
+    void calculateCoefficientsForDelay (double delayInSamples, SampleType* coefficients) const noexcept
+    {
+        auto delayFromNewest = delayInSamples - (double) getNewestTapDelay (delayInSamples);
+
+        if (interpolation == DelayInterpolation::thiran)
+            // delayFromNewest is in [0.5, 1.5), where the allpass has its flattest group delay
+            coefficients[0] = (SampleType) ((1.0 - delayFromNewest) / (1.0 + delayFromNewest));
+        else
+            calculateCoefficients (delayFromNewest, coefficients);
+    }
+
+    /** Fills in the FIR coefficients, oldest tap first, for a read point that is
+        delayFromNewest samples older than the newest tap.
+    */
+    void calculateCoefficients (double delayFromNewest, SampleType* coefficients) const noexcept
+    {
+        auto numTaps = getNumTaps();
+
+        switch (interpolation)
+        {
+            case DelayInterpolation::none:
+                coefficients[0] = SampleType (1);
+                break;
+
+            case DelayInterpolation::linear:
+            case DelayInterpolation::lagrange3:
+            case DelayInterpolation::lagrange5:
+                for (int k = 0; k < numTaps; ++k)
+                {
+                    auto h = 1.0;
+
+                    for (int m = 0; m < numTaps; ++m)
+                        if (m != k)
+                            h *= (delayFromNewest - m) / (double) (k - m);
+
+                    coefficients[numTaps - 1 - k] = (SampleType) h;
+                }
+                break;
+
+            case DelayInterpolation::windowedSinc:
+            {
+                const auto& table = getSincTable();
+                auto phase = juce::jlimit (0, sincPhases, juce::roundToInt ((delayFromNewest - getLookahead()) * sincPhases));
+
+                for (int j = 0; j < numTaps; ++j)
+                    coefficients[j] = (SampleType) table[(size_t) (phase * numTaps + j)];
+
+                break;
+            }
+
+            case DelayInterpolation::thiran:
+            default:
+                jassertfalse;
+                break;
+        }
+    }
+
+    //==============================================================================
+    static constexpr int sincPhases = 256;
+
+    /** (sincPhases + 1) rows of 8 Blackman-windowed sinc coefficients, oldest tap
+        first, each normalised to unity gain at DC.
+    */
+    static const std::vector<float>& getSincTable()
+    {
+        static const std::vector<float> table = []
+        {
+            constexpr int numTaps = 8, lookahead = 3;
+            std::vector<float> t ((size_t) ((sincPhases + 1) * numTaps));
+
+            for (int phase = 0; phase <= sincPhases; ++phase)
+            {
+                auto delayFromNewest = lookahead + (double) phase / sincPhases;
+                double row[numTaps], sum = 0.0;
+
+                for (int k = 0; k < numTaps; ++k)
+                {
+                    auto x = (double) k - delayFromNewest;
+                    auto sinc = std::abs (x) < 1.0e-9 ? 1.0 : std::sin (juce::MathConstants<double>::pi * x) / (juce::MathConstants<double>::pi * x);
+                    auto w = (x + numTaps / 2.0) / numTaps;
+                    auto window = 0.42 - 0.5 * std::cos (2.0 * juce::MathConstants<double>::pi * w)
+                                       + 0.08 * std::cos (4.0 * juce::MathConstants<double>::pi * w);
+                    row[k] = sinc * window;
+                    sum += row[k];
+                }
+
+                for (int k = 0; k < numTaps; ++k)
+                    t[(size_t) (phase * numTaps + numTaps - 1 - k)] = (float) (row[k] / sum);
+            }
+
+            return t;
+        }();
+
+        return table;
+    }
+
+    //==============================================================================
+    DelayInterpolation interpolation = DelayInterpolation::linear;
+    std::array<SampleType, NumChannels> thiranState {};
+
+    JUCE_DECLARE_NON_COPYABLE (FractionalDelayReader)
+};
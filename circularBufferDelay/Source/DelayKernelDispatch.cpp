@@ -0,0 +1,242 @@
+/*
+  ==============================================================================
+
+    DelayKernelDispatch.cpp
+
+  ==============================================================================
+*/
+
+#include "DelayKernelDispatch.h"
+#include "DelayKernels.h"
+#include "DelayInterpolation.h"
+#include "MultiTapDelay.h"
+#include "CompressedDelayLine.h"
+
+#if JUCE_MAC
+ #include <sys/sysctl.h>
+#elif JUCE_LINUX
+ #include <unistd.h>
+#endif
+
+namespace
+{
+    //==============================================================================
+    // The fused write/read/mix is plain C++ that the compiler vectorises, so each instruction set
+    // gets its own build of the same scalar loop
+    void writeReadFeedbackMixScalar (float* io, float* delayWrite, const float* delayRead, int numSamples,
+                                     float inputGain, float feedback, float dry, float wet) noexcept
+    {
+        DelayKernels::writeReadFeedbackMixScalar (io, delayWrite, delayRead, numSamples, inputGain, feedback, dry, wet);
+    }
+
+   #if JUCE_USE_SSE_INTRINSICS
+    DELAY_KERNEL_TARGET_AVX2
+    void writeReadFeedbackMixAVX2 (float* io, float* delayWrite, const float* delayRead, int numSamples,
+                                   float inputGain, float feedback, float dry, float wet) noexcept
+    {
+        DelayKernels::writeReadFeedbackMixScalar (io, delayWrite, delayRead, numSamples, inputGain, feedback, dry, wet);
+    }
+   #endif
+
+    //==============================================================================
+    using Interpolation = DelayInterpolationKernels;
+    using Codecs = DelaySampleCodecs;
+
+    const DelayKernelTable scalarKernels
+    {
+        DelayInstructionSet::scalar,
+        writeReadFeedbackMixScalar,
+        writeReadFeedbackMixScalar,
+        Interpolation::firScalar<float>,
+        Interpolation::gatherLinearScalar<float>,
+        Interpolation::gatherLagrange3Scalar<float>,
+        MultiTapKernels::processScalar<float>,
+        Codecs::Int16::encodeScalar,
+        Codecs::Int16::decodeScalar,
+        Codecs::Packed24::encodeScalar,
+        Codecs::Packed24::decodeScalar,
+        Codecs::Half::encodeScalar,
+        Codecs::Half::decodeScalar
+    };
+
+   #if JUCE_USE_SSE_INTRINSICS
+    // (SSE2 has no gather, and emulating one lane at a time doesn't pay for the Lagrange coefficients;
+    // it has no byte shuffle or half conversion for the codecs either)
+    const DelayKernelTable sse2Kernels
+    {
+        DelayInstructionSet::sse2,
+        writeReadFeedbackMixScalar,
+        DelayKernels::writeReadFeedbackMixStreamingSSE,
+        Interpolation::firSSE,
+        Interpolation::gatherLinearSSE,
+        Interpolation::gatherLagrange3Scalar<float>,
+        MultiTapKernels::processSSE,
+        Codecs::Int16::encodeSSE2,
+        Codecs::Int16::decodeSSE2,
+        Codecs::Packed24::encodeScalar,
+        Codecs::Packed24::decodeScalar,
+        Codecs::Half::encodeScalar,
+        Codecs::Half::decodeScalar
+    };
+
+    // (every CPU with AVX2 has SSSE3 and F16C too, so the codecs can use them here)
+    const DelayKernelTable avx2Kernels
+    {
+        DelayInstructionSet::avx2,
+        writeReadFeedbackMixAVX2,
+        DelayKernels::writeReadFeedbackMixStreamingAVX2,
+        Interpolation::firAVX2,
+        Interpolation::gatherLinearAVX2,
+        Interpolation::gatherLagrange3AVX2,
+        MultiTapKernels::processAVX2,
+        Codecs::Int16::encodeSSE2,
+        Codecs::Int16::decodeSSE2,
+        Codecs::Packed24::encodeSSSE3,
+        Codecs::Packed24::decodeSSSE3,
+        Codecs::Half::encodeF16C,
+        Codecs::Half::decodeF16C
+    };
+
+    // (the fused loop is limited by memory bandwidth rather than arithmetic, so it gains nothing from
+    // the wider registers, and a compiler targeting AVX-512 is free to fuse its multiplies and adds)
+    const DelayKernelTable avx512Kernels
+    {
+        DelayInstructionSet::avx512,
+        writeReadFeedbackMixAVX2,
+        DelayKernels::writeReadFeedbackMixStreamingAVX2,
+        Interpolation::firAVX512,
+        Interpolation::gatherLinearAVX512,
+        Interpolation::gatherLagrange3AVX512,
+        MultiTapKernels::processAVX512,
+        Codecs::Int16::encodeSSE2,
+        Codecs::Int16::decodeSSE2,
+        Codecs::Packed24::encodeSSSE3,
+        Codecs::Packed24::decodeSSSE3,
+        Codecs::Half::encodeF16C,
+        Codecs::Half::decodeF16C
+    };
+   #endif
+
+    const DelayKernelTable* findKernels (DelayInstructionSet instructionSet) noexcept
+    {
+        switch (instructionSet)
+        {
+            case DelayInstructionSet::scalar:   return &scalarKernels;
+
+           #if JUCE_USE_SSE_INTRINSICS
+            case DelayInstructionSet::sse2:     return juce::SystemStats::hasSSE2()    ? &sse2Kernels   : nullptr;
+            case DelayInstructionSet::avx2:     return juce::SystemStats::hasAVX2()    ? &avx2Kernels   : nullptr;
+            case DelayInstructionSet::avx512:   return juce::SystemStats::hasAVX512F() ? &avx512Kernels : nullptr;
+           #endif
+
+            default:                            return nullptr;
+        }
+    }
+
+    //==============================================================================
+    DelayInstructionSet detectBestInstructionSet() noexcept
+    {
+        for (auto instructionSet : { DelayInstructionSet::avx512, DelayInstructionSet::avx2, DelayInstructionSet::sse2 })
+            if (findKernels (instructionSet) != nullptr)
+                return instructionSet;
+
+        return DelayInstructionSet::scalar;
+    }
+
+    DelayInstructionSet chooseInstructionSet (DelayInstructionSet best)
+    {
+        auto forced = juce::SystemStats::getEnvironmentVariable ("CIRCULARBUFFERDELAY_FORCE_ISA", {}).trim().toLowerCase();
+
+        for (auto instructionSet : { DelayInstructionSet::scalar, DelayInstructionSet::sse2,
+                                     DelayInstructionSet::avx2, DelayInstructionSet::avx512 })
+            if (forced == DelayKernelDispatch::getName (instructionSet) && findKernels (instructionSet) != nullptr)
+                return instructionSet;
+
+        return best;
+    }
+
+    //==============================================================================
+    size_t detectCacheBytesPerCore() noexcept
+    {
+        size_t cacheBytes = 0;
+
+        // the largest level the OS knows of (Apple silicon has no L3, and its shared L2 is the last level)
+       #if JUCE_MAC
+        for (auto* name : { "hw.l3cachesize", "hw.l2cachesize" })
+        {
+            std::int64_t size = 0;
+            auto length = sizeof (size);
+
+            if (cacheBytes == 0 && sysctlbyname (name, &size, &length, nullptr, 0) == 0 && size > 0)
+                cacheBytes = (size_t) size;
+        }
+       #elif JUCE_LINUX
+        for (auto name : { _SC_LEVEL3_CACHE_SIZE, _SC_LEVEL2_CACHE_SIZE })
+        {
+            auto size = sysconf (name);
+
+            if (cacheBytes == 0 && size > 0)
+                cacheBytes = (size_t) size;
+        }
+       #endif
+
+        if (cacheBytes == 0)
+            cacheBytes = DelayKernelDispatch::defaultCacheBytes;
+
+        return cacheBytes / (size_t) juce::jmax (1, juce::SystemStats::getNumPhysicalCpus());
+    }
+
+    // asked once, when the plug-in's binary is loaded, and in this order
+    const DelayInstructionSet bestInstructionSet = detectBestInstructionSet();
+    std::atomic<const DelayKernelTable*> activeKernels { findKernels (chooseInstructionSet (bestInstructionSet)) };
+    const size_t cacheBytesPerCore = detectCacheBytesPerCore();
+}
+
+//==============================================================================
+const DelayKernelTable& DelayKernelDispatch::getKernels() noexcept
+{
+    return *activeKernels.load (std::memory_order_relaxed);
+}
+
+DelayInstructionSet DelayKernelDispatch::getBestInstructionSet() noexcept
+{
+    return bestInstructionSet;
+}
+
+bool DelayKernelDispatch::isSupported (DelayInstructionSet instructionSet) noexcept
+{
+    return findKernels (instructionSet) != nullptr;
+}
+
+bool DelayKernelDispatch::forceInstructionSet (DelayInstructionSet instructionSet) noexcept
+{
+    if (auto* kernels = findKernels (instructionSet))
+    {
+        activeKernels.store (kernels, std::memory_order_relaxed);
+        return true;
+    }
+
+    return false;
+}
+
+void DelayKernelDispatch::resetInstructionSet() noexcept
+{
+    activeKernels.store (findKernels (bestInstructionSet), std::memory_order_relaxed);
+}
+
+size_t DelayKernelDispatch::getCacheBytesPerCore() noexcept
+{
+    return cacheBytesPerCore;
+}
+
+const char* DelayKernelDispatch::getName (DelayInstructionSet instructionSet) noexcept
+{
+    switch (instructionSet)
+    {
+        case DelayInstructionSet::scalar:   return "scalar";
+        case DelayInstructionSet::sse2:     return "sse2";
+        case DelayInstructionSet::avx2:     return "avx2";
+        case DelayInstructionSet::avx512:   return "avx512";
+        default:                            return "";
+    }
+}
@@ -0,0 +1,147 @@
+/*
+  ==============================================================================
+
+    DelayKernelDispatch.h
+
+    Picks the widest instruction set the machine the plug-in is running on
+    supports, once, and hands out the delay kernels built for it.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <cstdint>
+
+// Kernels for instruction sets beyond the one the build targets are compiled as
+// such with a target attribute, so one binary carries all of them
+#if JUCE_USE_SSE_INTRINSICS
+ #include <immintrin.h>
+
+ // (AVX-512 brings FMA with it, and GCC would otherwise fuse a multiply and an add that the scalar
+ // reference rounds separately; Clang only ever fuses ones written in the same expression)
+ #if JUCE_CLANG
+  #define DELAY_KERNEL_TARGET_SSSE3     __attribute__ ((target ("ssse3")))
+  #define DELAY_KERNEL_TARGET_F16C      __attribute__ ((target ("avx,f16c")))
+  #define DELAY_KERNEL_TARGET_AVX2      __attribute__ ((target ("avx2")))
+  #define DELAY_KERNEL_TARGET_AVX512    __attribute__ ((target ("avx512f")))
+ #elif JUCE_GCC
+  #define DELAY_KERNEL_TARGET_SSSE3     __attribute__ ((target ("ssse3")))
+  #define DELAY_KERNEL_TARGET_F16C      __attribute__ ((target ("avx,f16c")))
+  #define DELAY_KERNEL_TARGET_AVX2      __attribute__ ((target ("avx2")))
+  #define DELAY_KERNEL_TARGET_AVX512    __attribute__ ((target ("avx512f"), optimize ("fp-contract=off")))
+ #else
+  #define DELAY_KERNEL_TARGET_SSSE3
+  #define DELAY_KERNEL_TARGET_F16C
+  #define DELAY_KERNEL_TARGET_AVX2
+  #define DELAY_KERNEL_TARGET_AVX512
+ #endif
+#endif
+
+// The scalar kernels are the reference, so they round each multiply and add on its own just as the
+// SIMD ones do, even where Clang would otherwise fuse them (always on arm64, and wherever one is inlined
+// into an AVX-512 kernel). Goes at the start of the kernel's body.
+#if JUCE_CLANG
+ #define DELAY_KERNEL_NO_FP_CONTRACT    _Pragma ("clang fp contract(off)")
+#else
+ #define DELAY_KERNEL_NO_FP_CONTRACT
+#endif
+
+//==============================================================================
+/** The instruction sets the delay kernels come in, narrowest first. */
+enum class DelayInstructionSet
+{
+    scalar,     /**< Plain C++: the reference every other version is checked against. */
+    sse2,
+    avx2,
+    avx512
+};
+
+//==============================================================================
+/**
+    One complete set of the float kernels on the delay path, all built for the
+    same instruction set. Each one does the same job as the scalar version
+    named in its comment; see there for what the arguments mean.
+*/
+struct DelayKernelTable
+{
+    DelayInstructionSet instructionSet;
+
+    /** DelayKernels::writeReadFeedbackMixScalar(): the write into the delay line, fused with the read and the mix. */
+    void (*writeReadFeedbackMix) (float* io, float* delayWrite, const float* delayRead, int numSamples,
+                                  float inputGain, float feedback, float dry, float wet) noexcept;
+
+    /** DelayKernels::writeReadFeedbackMixStreaming(): the same, for history too long to stay in cache. */
+    void (*writeReadFeedbackMixStreaming) (float* io, float* delayWrite, const float* delayRead, int numSamples,
+                                           float inputGain, float feedback, float dry, float wet) noexcept;
+
+    /** DelayInterpolationKernels::firScalar(): every FIR interpolator at a constant delay. */
+    void (*fir) (const float* oldest, float* dest, int numSamples, const float* coefficients, int numTaps) noexcept;
+
+    /** DelayInterpolationKernels::gatherLinearScalar() and gatherLagrange3Scalar(): modulated reads. */
+    void (*gatherLinear) (const float* data, int mask, int writePosition, const float* delays, float* dest, int numSamples) noexcept;
+    void (*gatherLagrange3) (const float* data, int mask, int writePosition, const float* delays, float* dest, int numSamples) noexcept;
+
+    /** MultiTapKernels::processScalar(): the taps and their lowpass filters. */
+    void (*multiTap) (const float* data, int mask, int position, const int* delays, const float* gains, const float* coefficients,
+                      float* states, int numTaps, float* output, int numSamples, float outputGain) noexcept;
+
+    /** DelaySampleCodecs::Int16, Packed24 and Half's encodeScalar() and decodeScalar(): CompressedDelayLine's formats. */
+    void (*encodeInt16) (const float* source, std::int16_t* dest, int numSamples, float scale) noexcept;
+    void (*decodeInt16) (const std::int16_t* source, float* dest, int numSamples, float scale) noexcept;
+    void (*encodePacked24) (const float* source, std::uint8_t* dest, int numSamples, float scale) noexcept;
+    void (*decodePacked24) (const std::uint8_t* source, float* dest, int numSamples, float scale) noexcept;
+    void (*encodeHalf) (const float* source, std::uint16_t* dest, int numSamples, float scale) noexcept;
+    void (*decodeHalf) (const std::uint16_t* source, float* dest, int numSamples, float scale) noexcept;
+};
+
+//==============================================================================
+/**
+    Chooses which DelayKernelTable the delay path uses.
+
+    The CPU is asked what it supports once, when the plug-in is loaded, and the
+    widest table it can run is used from then on, so a single build runs as
+    fast as it can on every generation of machine it lands on. Calls go
+    through the table's function pointers, once per block or stretch, never
+    per sample.
+
+    For testing, a narrower instruction set can be forced, either from code or
+    by setting the CIRCULARBUFFERDELAY_FORCE_ISA environment variable to
+    scalar, sse2, avx2 or avx512 before the plug-in loads. Forcing the scalar
+    kernels gives the reference output.
+
+    There are no hand-written kernels for ARM: arm64 builds run the scalar
+    ones, which the compiler vectorises for NEON by itself.
+*/
+struct DelayKernelDispatch
+{
+    /** The kernels in use. Safe to call from any thread. */
+    static const DelayKernelTable& getKernels() noexcept;
+
+    /** The widest instruction set this machine supports. */
+    static DelayInstructionSet getBestInstructionSet() noexcept;
+
+    /** True if this machine can run (and this build has) kernels for that instruction set. */
+    static bool isSupported (DelayInstructionSet) noexcept;
+
+    /** Switches to another instruction set's kernels, returning false (and
+        changing nothing) if it isn't supported. Takes effect from the next
+        kernel call, so it's safe while audio is running, but anything that
+        compares outputs should switch between blocks.
+    */
+    static bool forceInstructionSet (DelayInstructionSet) noexcept;
+
+    /** Goes back to the widest instruction set supported. */
+    static void resetInstructionSet() noexcept;
+
+    /** The last-level cache divided between the physical cores that share it,
+        as the OS reports it when the plug-in is loaded (a share of
+        defaultCacheBytes where it doesn't). See DelayKernels::shouldStream().
+    */
+    static size_t getCacheBytesPerCore() noexcept;
+
+    static constexpr size_t defaultCacheBytes = (size_t) 8 << 20;
+
+    static const char* getName (DelayInstructionSet) noexcept;
+};
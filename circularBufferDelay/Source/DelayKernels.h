@@ -0,0 +1,293 @@
+/*
+  ==============================================================================
+
+    DelayKernels.h
+
+    The inner loops of the delay path, kept apart from the buffer bookkeeping
+    so that they only ever see plain contiguous pointers.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "DelayKernelDispatch.h"
+
+//==============================================================================
+/**
+    Stateless per-channel loops that run over one contiguous stretch of the
+    host buffer and the delay memory at a time.
+
+    A delay is limited by memory bandwidth rather than arithmetic, so each one
+    does all of its work in a single sweep. Per float sample and channel,
+    writeReadFeedbackMix() moves 16 bytes: the input and the delayed sample
+    in, the feedback and the output out. Copying the input in, reading the
+    delayed samples out to a scratch buffer and mixing in separate passes
+    would move 32, and sweep the delay memory twice.
+*/
+struct DelayKernels
+{
+    /** Below this many samples of delay, feedback goes through
+        writeReadFeedbackMixRecursive() a sample at a time rather than in
+        stretches of at most the delay, which would be too short to vectorise.
+    */
+    static constexpr int minimumDelayForStretches = 16;
+
+    /** True once more history (all the channels' worth) sits between the write
+        head and the read head than this core's share of the last-level cache
+        (DelayKernelDispatch::getCacheBytesPerCore()). By the time what's written
+        is read back, the rest of the process and the other cores will have had
+        every chance to evict it, so the delay switches to
+        writeReadFeedbackMixStreaming(). Below that, enough of the history is
+        still in cache that plain stores win, as the streaming ones always go
+        out to memory.
+
+        Within the 2000 ms that Max Delay goes up to, it takes a high sample rate
+        to get there: e.g. 2 s of stereo floats at 192 kHz is 3 MB, against the
+        few MB a core gets on most desktop CPUs.
+    */
+    static bool shouldStream (int delaySamples, int numChannels, size_t bytesPerSample) noexcept
+    {
+        return (size_t) delaySamples * (size_t) numChannels * bytesPerSample > DelayKernelDispatch::getCacheBytesPerCore();
+    }
+
+    /** The whole delay in one sweep: for each sample, read the delayed sample,
+        write input * inputGain + delayed * feedback back into the delay line,
+        and replace the input with input * dry + delayed * wet.
+
+        None of the three ranges may overlap, so with feedback a stretch can be
+        no longer than the delay: otherwise it would read samples it's about to
+        write. Mirrored memory can alias through different addresses, which no
+        runtime check would catch, so the pointers are marked as never aliasing
+        and the compiler is free to vectorise.
+
+        The delay memory can hold a different precision from the host buffer
+        (e.g. float history behind double I/O): the arithmetic is done in the
+        host's, and each sample is converted as it's read or written, in the
+        same pass.
+    */
+    template <typename SampleType, typename StorageType>
+    static void writeReadFeedbackMixScalar (SampleType* __restrict io,
+                                            StorageType* __restrict delayWrite,
+                                            const StorageType* __restrict delayRead,
+                                            int numSamples,
+                                            SampleType inputGain,
+                                            SampleType feedback,
+                                            SampleType dry,
+                                            SampleType wet) noexcept
+    {
+        DELAY_KERNEL_NO_FP_CONTRACT
+
+        for (int i = 0; i < numSamples; ++i)
+        {
+            auto input   = io[i];
+            auto delayed = static_cast<SampleType> (delayRead[i]);
+
+            delayWrite[i] = static_cast<StorageType> (input * inputGain + delayed * feedback);
+            io[i]         = input * dry + delayed * wet;
+        }
+    }
+
+    /** writeReadFeedbackMixScalar(), which the compiler vectorises by itself, built
+        for the widest instruction set the machine supports (see DelayKernelDispatch).
+    */
+    static void writeReadFeedbackMix (float* io, float* delayWrite, const float* delayRead, int numSamples,
+                                      float inputGain, float feedback, float dry, float wet) noexcept
+    {
+        DelayKernelDispatch::getKernels().writeReadFeedbackMix (io, delayWrite, delayRead, numSamples, inputGain, feedback, dry, wet);
+    }
+
+    template <typename SampleType, typename StorageType>
+    static void writeReadFeedbackMix (SampleType* io, StorageType* delayWrite, const StorageType* delayRead, int numSamples,
+                                      SampleType inputGain, SampleType feedback, SampleType dry, SampleType wet) noexcept
+    {
+        writeReadFeedbackMixScalar (io, delayWrite, delayRead, numSamples, inputGain, feedback, dry, wet);
+    }
+
+    /** writeReadFeedbackMix() for delays too long for their history to stay in
+        cache: the delay line is written with non-temporal stores, which don't
+        evict anything on their way out to memory, and the read head asks for
+        the cache lines it's about to need a few lines ahead. The arithmetic
+        is the same, so the output is too.
+
+        Only the float kernels stream; anything else falls back to the plain one.
+    */
+    static void writeReadFeedbackMixStreaming (float* io, float* delayWrite, const float* delayRead, int numSamples,
+                                               float inputGain, float feedback, float dry, float wet) noexcept
+    {
+        DelayKernelDispatch::getKernels().writeReadFeedbackMixStreaming (io, delayWrite, delayRead, numSamples, inputGain, feedback, dry, wet);
+    }
+
+    template <typename SampleType, typename StorageType>
+    static void writeReadFeedbackMixStreaming (SampleType* io, StorageType* delayWrite, const StorageType* delayRead, int numSamples,
+                                               SampleType inputGain, SampleType feedback, SampleType dry, SampleType wet) noexcept
+    {
+        writeReadFeedbackMixScalar (io, delayWrite, delayRead, numSamples, inputGain, feedback, dry, wet);
+    }
+
+    /** How far ahead of the read head the streaming kernels prefetch, one cache line at a time. */
+    static constexpr int floatsPerCacheLine = 64 / (int) sizeof (float);
+    static constexpr int prefetchDistance = 8 * floatsPerCacheLine;
+
+   #if JUCE_USE_SSE_INTRINSICS
+    /** The delay memory's slabs are cache-line aligned, but the write head
+        can be anywhere, so these do a few samples on their own until it
+        reaches a whole vector, stream vectors from there, and finish the
+        leftovers on their own again. The prefetches count lines from wherever
+        the vectors start, not from the index, which the lead-in leaves at any
+        offset. The sfence at the end makes the streamed samples visible to the
+        background threads that read the line.
+    */
+    static void writeReadFeedbackMixStreamingSSE (float* __restrict io, float* __restrict delayWrite, const float* __restrict delayRead,
+                                                  int numSamples, float inputGain, float feedback, float dry, float wet) noexcept
+    {
+        int i = 0;
+
+        for (; i < numSamples && (reinterpret_cast<juce::pointer_sized_uint> (delayWrite + i) & 15) != 0; ++i)
+            writeReadFeedbackMixScalar (io + i, delayWrite + i, delayRead + i, 1, inputGain, feedback, dry, wet);
+
+        auto g = _mm_set1_ps (inputGain), f = _mm_set1_ps (feedback), d = _mm_set1_ps (dry), w = _mm_set1_ps (wet);
+        auto nextPrefetch = i;
+
+        for (; i + 4 <= numSamples; i += 4)
+        {
+            if (i >= nextPrefetch)
+            {
+                _mm_prefetch (reinterpret_cast<const char*> (delayRead + i + prefetchDistance), _MM_HINT_T0);
+                nextPrefetch = i + floatsPerCacheLine;
+            }
+
+            auto input   = _mm_loadu_ps (io + i);
+            auto delayed = _mm_loadu_ps (delayRead + i);
+
+            _mm_stream_ps (delayWrite + i, _mm_add_ps (_mm_mul_ps (input, g), _mm_mul_ps (delayed, f)));
+            _mm_storeu_ps (io + i, _mm_add_ps (_mm_mul_ps (input, d), _mm_mul_ps (delayed, w)));
+        }
+
+        writeReadFeedbackMixScalar (io + i, delayWrite + i, delayRead + i, numSamples - i, inputGain, feedback, dry, wet);
+        _mm_sfence();
+    }
+
+    DELAY_KERNEL_TARGET_AVX2
+    static void writeReadFeedbackMixStreamingAVX2 (float* __restrict io, float* __restrict delayWrite, const float* __restrict delayRead,
+                                                   int numSamples, float inputGain, float feedback, float dry, float wet) noexcept
+    {
+        int i = 0;
+
+        for (; i < numSamples && (reinterpret_cast<juce::pointer_sized_uint> (delayWrite + i) & 31) != 0; ++i)
+            writeReadFeedbackMixScalar (io + i, delayWrite + i, delayRead + i, 1, inputGain, feedback, dry, wet);
+
+        auto g = _mm256_set1_ps (inputGain), f = _mm256_set1_ps (feedback), d = _mm256_set1_ps (dry), w = _mm256_set1_ps (wet);
+        auto nextPrefetch = i;
+
+        for (; i + 8 <= numSamples; i += 8)
+        {
+            if (i >= nextPrefetch)
+            {
+                _mm_prefetch (reinterpret_cast<const char*> (delayRead + i + prefetchDistance), _MM_HINT_T0);
+                nextPrefetch = i + floatsPerCacheLine;
+            }
+
+            auto input   = _mm256_loadu_ps (io + i);
+            auto delayed = _mm256_loadu_ps (delayRead + i);
+
+            _mm256_stream_ps (delayWrite + i, _mm256_add_ps (_mm256_mul_ps (input, g), _mm256_mul_ps (delayed, f)));
+            _mm256_storeu_ps (io + i, _mm256_add_ps (_mm256_mul_ps (input, d), _mm256_mul_ps (delayed, w)));
+        }
+
+        writeReadFeedbackMixScalar (io + i, delayWrite + i, delayRead + i, numSamples - i, inputGain, feedback, dry, wet);
+        _mm_sfence();
+    }
+   #endif
+
+    /** writeReadFeedbackMixScalar() while the input gain is moving: sample i is
+        written with inputGain + gainStep * (i + 1), so a stretch ends on the
+        gain the next one starts from. The ramp is worked out from the index
+        rather than accumulated, so the compiler vectorises it with the rest.
+        (The input gain is only ever folded into the multiply that's there
+        anyway, so a constant one, even exactly 1, costs nothing extra and
+        goes through writeReadFeedbackMix(); this is only for the few blocks
+        a change takes.)
+    */
+    template <typename SampleType, typename StorageType>
+    static void writeReadFeedbackMixRamp (SampleType* __restrict io,
+                                          StorageType* __restrict delayWrite,
+                                          const StorageType* __restrict delayRead,
+                                          int numSamples,
+                                          SampleType inputGain,
+                                          SampleType gainStep,
+                                          SampleType feedback,
+                                          SampleType dry,
+                                          SampleType wet) noexcept
+    {
+        for (int i = 0; i < numSamples; ++i)
+        {
+            auto input   = io[i];
+            auto delayed = static_cast<SampleType> (delayRead[i]);
+            auto gain    = inputGain + gainStep * static_cast<SampleType> (i + 1);
+
+            delayWrite[i] = static_cast<StorageType> (input * gain + delayed * feedback);
+            io[i]         = input * dry + delayed * wet;
+        }
+    }
+
+    /** writeReadFeedbackMixScalar() for a stretch whose delayed samples are all
+        silent (what's left of history that's been cleared lazily), without
+        reading them: 12 bytes per sample rather than 16. The input gain can
+        ramp, as in writeReadFeedbackMixRamp().
+    */
+    template <typename SampleType, typename StorageType>
+    static void writeMixSilent (SampleType* __restrict io,
+                                StorageType* __restrict delayWrite,
+                                int numSamples,
+                                SampleType inputGain,
+                                SampleType dry,
+                                SampleType gainStep = SampleType()) noexcept
+    {
+        for (int i = 0; i < numSamples; ++i)
+        {
+            auto input = io[i];
+
+            delayWrite[i] = static_cast<StorageType> (input * (inputGain + gainStep * static_cast<SampleType> (i + 1)));
+            io[i]         = input * dry;
+        }
+    }
+
+    /** The same as writeReadFeedbackMixScalar(), but indexing the delay memory
+        directly, one sample after another, so each output can feed back into
+        one delaySamples later in the same call. This is the path for delays
+        shorter than minimumDelayForStretches (combs, Karplus-Strong): the loop
+        carries a dependency from one sample to the next, so it's scalar.
+
+        delayData is a whole channel of a delay line, with capacity mask + 1,
+        and writePosition is where io[0] gets written. The input gain can
+        ramp, as in writeReadFeedbackMixRamp().
+    */
+    template <typename SampleType, typename StorageType>
+    static void writeReadFeedbackMixRecursive (SampleType* io,
+                                               StorageType* delayData,
+                                               int mask,
+                                               int writePosition,
+                                               int delaySamples,
+                                               int numSamples,
+                                               SampleType inputGain,
+                                               SampleType feedback,
+                                               SampleType dry,
+                                               SampleType wet,
+                                               SampleType gainStep = SampleType()) noexcept
+    {
+        jassert (delaySamples > 0);
+
+        for (int i = 0; i < numSamples; ++i)
+        {
+            auto position = (writePosition + i) & mask;
+            auto input    = io[i];
+            auto delayed  = static_cast<SampleType> (delayData[(position - delaySamples) & mask]);
+            auto gain     = inputGain + gainStep * static_cast<SampleType> (i + 1);
+
+            delayData[position] = static_cast<StorageType> (input * gain + delayed * feedback);
+            io[i]               = input * dry + delayed * wet;
+        }
+    }
+};
@@ -0,0 +1,106 @@
+/*
+  ==============================================================================
+
+    DelayKernelsTests.cpp
+
+    Runs the fused write/read/mix kernels, streaming and plain, on every
+    instruction set the machine supports against the scalar reference, and
+    checks where shouldStream() switches over. Registered with JUCE's
+    UnitTestRunner by the static instance at the bottom.
+
+  ==============================================================================
+*/
+
+#include "DelayKernels.h"
+
+//==============================================================================
+class DelayKernelsTests  : public juce::UnitTest
+{
+public:
+    DelayKernelsTests()  : juce::UnitTest ("DelayKernels streaming", "Delay") {}
+
+    void runTest() override
+    {
+        beginTest ("Streaming and plain kernels match the scalar reference on every instruction set");
+        for (auto instructionSet : { DelayInstructionSet::scalar, DelayInstructionSet::sse2,
+                                     DelayInstructionSet::avx2, DelayInstructionSet::avx512 })
+        {
+            if (! DelayKernelDispatch::forceInstructionSet (instructionSet))
+                continue;
+
+            checkKernel (DelayKernels::writeReadFeedbackMixStreaming);
+            checkKernel (DelayKernels::writeReadFeedbackMix);
+        }
+
+        DelayKernelDispatch::resetInstructionSet();
+
+        beginTest ("Streaming starts once the history outgrows a core's share of the cache");
+        {
+            auto cacheBytes = DelayKernelDispatch::getCacheBytesPerCore();
+            auto numSamples = (int) (cacheBytes / (2 * sizeof (float)));
+
+            expect (cacheBytes > 0, "no cache size");
+            expect (! DelayKernels::shouldStream (numSamples, 2, sizeof (float)), "streams history that fits in the cache");
+            expect (DelayKernels::shouldStream (numSamples + 1, 2, sizeof (float)), "doesn't stream history that outgrows the cache");
+        }
+    }
+
+private:
+    //==============================================================================
+    using Kernel = void (*) (float*, float*, const float*, int, float, float, float, float);
+
+    // Random stretches written from every offset within a cache line, so the streaming kernels' lead-in,
+    // vector body and tail all get their turn; the output and what's written into the delay memory must
+    // match the scalar loop to the bit, and the delay memory either side of the stretch mustn't change
+    void checkKernel (Kernel kernel)
+    {
+        auto random = getRandom();
+        constexpr int maxLength = 300, floatsPerLine = DelayKernels::floatsPerCacheLine;
+        constexpr float untouched = 12345.0f;
+
+        std::vector<float> delayMemory ((size_t) (maxLength + 3 * floatsPerLine));
+        auto* delayWrite = delayMemory.data();
+
+        // (the slabs the kernels see are cache-line aligned, so this is too)
+        while ((reinterpret_cast<juce::pointer_sized_uint> (delayWrite) & 63) != 0)
+            ++delayWrite;
+
+        std::vector<float> input ((size_t) maxLength), delayRead ((size_t) maxLength), io ((size_t) maxLength),
+                           expectedIo ((size_t) maxLength), expectedWrite ((size_t) maxLength);
+        auto mismatches = 0;
+
+        for (int trial = 0; trial < 400; ++trial)
+        {
+            auto length = random.nextInt (maxLength + 1);
+            auto offset = random.nextInt (floatsPerLine);
+            auto inputGain = random.nextFloat(), feedback = random.nextFloat() * 0.99f;
+            auto dry = random.nextFloat(), wet = random.nextFloat();
+
+            for (int i = 0; i < length; ++i)
+            {
+                input[(size_t) i] = random.nextFloat() * 2.0f - 1.0f;
+                delayRead[(size_t) i] = random.nextFloat() * 2.0f - 1.0f;
+            }
+
+            std::fill (delayWrite, delayWrite + maxLength + 2 * floatsPerLine, untouched);
+            std::copy (input.begin(), input.begin() + length, io.begin());
+            std::copy (input.begin(), input.begin() + length, expectedIo.begin());
+
+            kernel (io.data(), delayWrite + offset, delayRead.data(), length, inputGain, feedback, dry, wet);
+            DelayKernels::writeReadFeedbackMixScalar (expectedIo.data(), expectedWrite.data(), delayRead.data(), length,
+                                                      inputGain, feedback, dry, wet);
+
+            for (int i = 0; i < length; ++i)
+                if (io[(size_t) i] != expectedIo[(size_t) i] || delayWrite[offset + i] != expectedWrite[(size_t) i])
+                    ++mismatches;
+
+            for (int i = 0; i < maxLength + 2 * floatsPerLine; ++i)
+                if ((i < offset || i >= offset + length) && delayWrite[i] != untouched)
+                    ++mismatches;
+        }
+
+        expectEquals (mismatches, 0, "a kernel doesn't match the scalar reference");
+    }
+};
+
+static DelayKernelsTests delayKernelsTests;
@@ -0,0 +1,288 @@
+/*
+  ==============================================================================
+
+    DelayLineCapture.h
+
+    Dumps the recent history of a CircularDelayLine to an audio file after the
+    fact, for catching a take that nobody thought to record.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "CircularDelayLine.h"
+#include <array>
+#include <atomic>
+#include <vector>
+
+//==============================================================================
+/**
+    Writes the last few seconds of a CircularDelayLine to a WAV or FLAC file on
+    a background thread, while the audio thread carries on writing the line.
+
+    The line's memory belongs to the audio thread, so that's the thread that
+    copies the history out of it: each copyHistory() (one per audio callback)
+    copies the next slice of it, oldest first, into a buffer set aside by
+    startCapture(), and the background thread takes it from there to the file.
+    A slice is at most sliceSize samples a channel, so no callback does much
+    more work than another. The line's writer laps the oldest history first,
+    so this is a race the capture wins easily unless it asks for almost the
+    whole line: any samples that were overwritten before their slice was
+    copied are written as silence and counted in the Result. History from
+    before the line's last clearLazily() is written as silence too, as that's
+    what it plays back as (but isn't counted, as nothing was lost).
+
+    The line must keep its storage for as long as a capture runs, i.e. it mustn't
+    be prepared again or resized; stopCapture() cuts a capture short for that.
+*/
+template <typename SampleType, int NumChannels>
+class DelayLineCapture  : private juce::Thread
+{
+public:
+    //==============================================================================
+    using Line = CircularDelayLine<SampleType, NumChannels>;
+
+    /** The most each copyHistory() copies, per channel. */
+    static constexpr int sliceSize = 8192;
+
+    explicit DelayLineCapture (const Line& lineToCapture)
+        : juce::Thread ("Delay line capture"), line (lineToCapture)
+    {
+    }
+
+    ~DelayLineCapture() override
+    {
+        stopCapture();
+    }
+
+    //==============================================================================
+    /** What the last capture did. */
+    struct Result
+    {
+        juce::File file;
+        juce::int64 numSamplesWritten = 0;
+        juce::int64 numSamplesLost = 0;     /**< Overwritten before they could be copied, so written as silence. */
+        bool succeeded = false;
+    };
+
+    /** Starts writing the numSamples of history before the line's write head (as
+        it is at the next copyHistory()) to destination, scaled by gain. A .flac
+        extension writes FLAC and anything else WAV, both 24-bit. maximumBlockSize
+        is the most the audio thread writes between calls to copyHistory().
+
+        Returns false if a capture is already running or the file can't be
+        created. Call it from the message thread.
+    */
+    bool startCapture (const juce::File& destination, int numSamples, double sampleRate,
+                       int maximumBlockSize, SampleType gain = SampleType (1))
+    {
+        if (isCapturing())
+            return false;
+
+        stopThread (1000);
+
+        job.file = destination;
+        job.numSamples = (int) juce::jlimit ((juce::int64) 0, juce::jmin (line.getNumSamplesWritten(), (juce::int64) (line.getCapacity() - maximumBlockSize)),
+                                             (juce::int64) numSamples);
+        job.sampleRate = sampleRate;
+        job.gain = gain;
+
+        writer = createWriter();
+
+        if (writer == nullptr)
+            return false;
+
+        for (int channel = 0; channel < NumChannels; ++channel)
+            history[(size_t) channel].assign (channel < line.getNumChannels() ? (size_t) job.numSamples : 0, SampleType());
+
+        copyStarted = false;
+        numCopied.store (0);
+        numLost.store (0);
+        copyPending.store (true, std::memory_order_release);
+
+        capturing = true;
+        startThread();
+        return true;
+    }
+
+    /** Stops any capture that's running, finishing the file with what's been
+        written so far, and waits for the background thread to exit. The audio
+        thread mustn't be calling copyHistory() meanwhile, so call it from
+        prepareToPlay() or a destructor.
+    */
+    void stopCapture()
+    {
+        stopThread (4000);
+
+        copyPending.store (false);
+        writer.reset();
+        capturing = false;
+    }
+
+    bool isCapturing() const noexcept       { return capturing.load(); }
+
+    /** Call from the audio thread between blocks (i.e. after the line's
+        advance()), once per callback. Copies the next slice of any history a
+        capture is waiting for. Doesn't allocate or block.
+    */
+    void copyHistory() noexcept
+    {
+        if (! copyPending.load (std::memory_order_acquire))
+            return;
+
+        auto now = line.getNumSamplesWritten();
+
+        if (! copyStarted)
+        {
+            copyStarted = true;
+            copyEnd = now;
+        }
+
+        auto copied = numCopied.load (std::memory_order_relaxed);
+        auto from = copyEnd - job.numSamples + copied;
+        auto length = juce::jmin (sliceSize, job.numSamples - copied);
+
+        // whatever the writer has lapped is gone, and whatever's older than the last clearLazily() is
+        // silence as far as everything else reading the line is concerned, so it's left silent here too
+        auto numLapped = (int) juce::jlimit ((juce::int64) 0, (juce::int64) length, now - line.getCapacity() - from);
+        auto numSilent = juce::jmax (numLapped, line.getNumStaleSamples (length, (int) (now - from)));
+
+        for (int channel = 0; channel < line.getNumChannels() && numSilent < length; ++channel)
+        {
+            auto* dest = history[(size_t) channel].data() + copied;
+
+            line.getReadRegion (channel, length - numSilent, (int) (now - from - numSilent))
+                .forEachSegment ([dest, numSilent] (SampleSpan<const SampleType> segment, int offset)
+                {
+                    juce::FloatVectorOperations::copy (dest + numSilent + offset, segment.data, segment.size);
+                });
+        }
+
+        // (done before the slice is published, so that once the background thread has all of it, a new
+        // capture can start without this thread still owning the last one)
+        if (copied + length == job.numSamples)
+            copyPending.store (false, std::memory_order_relaxed);
+
+        numLost.fetch_add (numLapped, std::memory_order_relaxed);
+        numCopied.store (copied + length, std::memory_order_release);
+    }
+
+    /** The outcome of the most recent capture that has finished. */
+    Result getLastResult() const
+    {
+        const juce::ScopedLock sl (resultLock);
+        return lastResult;
+    }
+
+private:
+    //==============================================================================
+    static constexpr int chunkSize = 8192;
+    static constexpr int pollIntervalMs = 10;
+
+    struct Job
+    {
+        juce::File file;
+        int numSamples = 0;
+        double sampleRate = 44100.0;
+        SampleType gain = SampleType (1);
+    };
+
+    void run() override
+    {
+        Result result;
+        result.file = job.file;
+        result.succeeded = true;
+
+        auto numChannels = line.getNumChannels();
+        juce::AudioBuffer<float> chunk (numChannels, chunkSize);
+
+        for (auto written = 0; written < job.numSamples && ! threadShouldExit();)
+        {
+            // the audio thread can't wake us when it's copied another slice, so poll
+            auto length = juce::jmin (chunkSize, numCopied.load (std::memory_order_acquire) - written);
+
+            if (length <= 0)
+            {
+                wait (pollIntervalMs);
+                continue;
+            }
+
+            for (int channel = 0; channel < numChannels; ++channel)
+            {
+                const auto* source = history[(size_t) channel].data() + written;
+                auto* dest = chunk.getWritePointer (channel);
+
+                for (int i = 0; i < length; ++i)
+                    dest[i] = (float) (source[i] * job.gain);
+            }
+
+            // (after a failed write, the rest is still taken off the audio thread's hands, but goes nowhere)
+            if (result.succeeded && ! writer->writeFromAudioSampleBuffer (chunk, 0, length))
+                result.succeeded = false;
+
+            written += length;
+
+            if (result.succeeded)
+                result.numSamplesWritten += length;
+        }
+
+        result.numSamplesLost = numLost.load (std::memory_order_relaxed);
+
+        // the writer finishes the file as it goes
+        writer.reset();
+
+        {
+            const juce::ScopedLock sl (resultLock);
+            lastResult = result;
+        }
+
+        capturing = false;
+    }
+
+    std::unique_ptr<juce::AudioFormatWriter> createWriter() const
+    {
+        juce::WavAudioFormat wav;
+        juce::FlacAudioFormat flac;
+        juce::AudioFormat& format = job.file.hasFileExtension ("flac") ? static_cast<juce::AudioFormat&> (flac) : wav;
+
+        job.file.deleteFile();
+        std::unique_ptr<juce::FileOutputStream> stream (job.file.createOutputStream());
+
+        if (stream == nullptr)
+            return {};
+
+        std::unique_ptr<juce::AudioFormatWriter> newWriter (format.createWriterFor (stream.get(), job.sampleRate,
+                                                                                    (unsigned int) line.getNumChannels(),
+                                                                                    24, {}, 0));
+
+        // the writer owns the stream from here on
+        if (newWriter != nullptr)
+            stream.release();
+
+        return newWriter;
+    }
+
+    //==============================================================================
+    const Line& line;
+    Job job;
+    std::unique_ptr<juce::AudioFormatWriter> writer;
+    std::atomic<bool> capturing { false };
+
+    // the history on its way from the audio thread to the background thread: the audio thread
+    // fills it a slice at a time, and numCopied says how far it's got
+    std::array<std::vector<SampleType>, NumChannels> history;
+    std::atomic<bool> copyPending { false };
+    std::atomic<int> numCopied { 0 };
+    std::atomic<juce::int64> numLost { 0 };
+
+    // audio thread only
+    bool copyStarted = false;
+    juce::int64 copyEnd = 0;
+
+    juce::CriticalSection resultLock;
+    Result lastResult;
+
+    JUCE_DECLARE_NON_COPYABLE (DelayLineCapture)
+};
@@ -0,0 +1,223 @@
+/*
+  ==============================================================================
+
+    DelayLineResizer.h
+
+    Grows or shrinks a CircularDelayLine while audio is running, without the
+    audio thread ever allocating, freeing or waiting on a lock.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "CircularDelayLine.h"
+#include <limits>
+
+//==============================================================================
+/**
+    Builds new storage for a CircularDelayLine on a background thread and
+    passes it to the audio thread through an atomic pointer.
+
+    requestResize() (from any thread but the audio thread) wakes the
+    background thread, which allocates and clears the new memory. The line's
+    memory belongs to the audio thread, so that's where the history that fits
+    is copied across: each swapIfReady() copies the next slice of it, oldest
+    first, and once it has caught up with the write head, swaps the storage in
+    and sends the old storage back to be freed. A slice is a few times longer
+    than a block, so the copy catches up within a handful of callbacks, none
+    of which does much more work than another. Until then the line keeps its
+    old size, so callers have to clamp their delays to getMaximumDelay() every
+    block anyway.
+
+    Only one resize is in flight at a time; a request made while another is
+    waiting to be swapped in is picked up once that's done.
+
+    As the one thread that's allowed to touch the line's storage while audio
+    runs, it can also zero the history a CircularDelayLine::clearLazily() has
+    left stale, between resizes, so that readers stop checking for it sooner.
+*/
+template <typename SampleType, int NumChannels>
+class DelayLineResizer  : private juce::Thread
+{
+public:
+    //==============================================================================
+    using Line = CircularDelayLine<SampleType, NumChannels>;
+
+    explicit DelayLineResizer (Line& lineToResize)
+        : juce::Thread ("Delay line resizer"), line (lineToResize)
+    {
+    }
+
+    ~DelayLineResizer() override
+    {
+        stopThread (2000);
+        delete ready.exchange (nullptr);
+        delete finished.exchange (nullptr);
+        delete copying;
+    }
+
+    //==============================================================================
+    /** Asks for the line to be rebuilt with this many channels and at least this
+        capacity. maximumBlockSize is the most the audio thread writes between
+        calls to swapIfReady(), which decides how much of the history each of
+        them copies, so that the copy keeps well ahead of the writer.
+    */
+    void requestResize (int numChannels, int minimumCapacity, int maximumBlockSize)
+    {
+        {
+            const juce::ScopedLock sl (lock);
+            request = { numChannels, minimumCapacity, maximumBlockSize };
+            hasRequest = true;
+        }
+
+        startThread();
+        notify();
+    }
+
+    /** Turns zeroing stale history in the background on or off. maximumBlockSize
+        is as for requestResize().
+    */
+    void setClearsInBackground (bool shouldClear, int maximumBlockSize)
+    {
+        {
+            const juce::ScopedLock sl (lock);
+            clearsInBackground = shouldClear;
+            clearingBlockSize = maximumBlockSize;
+        }
+
+        if (shouldClear)
+        {
+            startThread();
+            notify();
+        }
+    }
+
+    /** True from a requestResize() until the old storage is back from the audio
+        thread, i.e. while the line's storage may be swapped under a reader.
+    */
+    bool isResizing() const
+    {
+        const juce::ScopedLock sl (lock);
+        return hasRequest || resizeInFlight;
+    }
+
+    /** Call at the start of every audio callback, before using the line. If new
+        storage is waiting, copies the next slice of history into it, and once
+        that's caught up with the write head, swaps it in. Doesn't allocate,
+        free or block.
+    */
+    void swapIfReady() noexcept
+    {
+        if (copying == nullptr)
+            copying = ready.exchange (nullptr, std::memory_order_acquire);
+
+        if (copying == nullptr)
+            return;
+
+        // nothing older than both the old and the new storage can hold is worth copying
+        auto now = line.getNumSamplesWritten();
+        auto oldest = now - juce::jmin (line.getCapacity(), copying->storage->getCapacity());
+
+        copying->copiedUpTo = juce::jmax (copying->copiedUpTo, oldest);
+
+        auto length = (int) juce::jmin ((juce::int64) copying->sliceSize, now - copying->copiedUpTo);
+        line.copyHistoryTo (*copying->storage, copying->copiedUpTo + length, length);
+        copying->copiedUpTo += length;
+
+        if (copying->copiedUpTo < now)
+            return;
+
+        copying->storage = line.adoptStorage (std::move (copying->storage));
+
+        // the old storage goes back to the background thread to be freed
+        finished.store (copying, std::memory_order_release);
+        copying = nullptr;
+    }
+
+private:
+    //==============================================================================
+    struct Request
+    {
+        int numChannels = 0, minimumCapacity = 0, maximumBlockSize = 0;
+    };
+
+    struct Job
+    {
+        std::unique_ptr<typename Line::Storage> storage;
+        int sliceSize = 0;
+
+        // how far the history has been copied (audio thread only)
+        juce::int64 copiedUpTo = std::numeric_limits<juce::int64>::min() / 2;
+    };
+
+    /** The least a swapIfReady() copies, per channel, while there's that much to copy. */
+    static constexpr int copySliceSize = 16384;
+
+    void run() override
+    {
+        while (! threadShouldExit())
+        {
+            auto waitingForSwap = false, canClear = false;
+            auto blockSize = 0;
+
+            {
+                const juce::ScopedLock sl (lock);
+
+                if (auto* job = finished.exchange (nullptr, std::memory_order_acquire))
+                {
+                    delete job;
+                    resizeInFlight = false;
+                }
+
+                if (hasRequest && ! resizeInFlight)
+                {
+                    hasRequest = false;
+                    resizeInFlight = true;
+                    ready.store (build (request).release(), std::memory_order_release);
+                }
+
+                waitingForSwap = resizeInFlight;
+
+                // (storage only changes when this thread has a resize in flight, so otherwise it's safe to write to)
+                canClear = clearsInBackground && ! resizeInFlight;
+                blockSize = clearingBlockSize;
+            }
+
+            if (canClear && line.zeroStaleHistory (blockSize, clearingChunkSize) > 0)
+                continue;
+
+            // the audio thread can't wake us when it hands storage back or clears the line, so poll for that
+            wait (waitingForSwap || canClear ? 20 : -1);
+        }
+    }
+
+    std::unique_ptr<Job> build (const Request& r) const
+    {
+        auto job = std::make_unique<Job>();
+        job->storage = line.createStorage (r.numChannels, r.minimumCapacity);
+
+        // (always well ahead of the writer, so the copy is sure to catch up with it)
+        job->sliceSize = juce::jmax (copySliceSize, 4 * r.maximumBlockSize);
+        return job;
+    }
+
+    //==============================================================================
+    Line& line;
+
+    juce::CriticalSection lock;
+    Request request;
+    bool hasRequest = false, resizeInFlight = false;
+    bool clearsInBackground = false;
+    int clearingBlockSize = 0;
+
+    static constexpr int clearingChunkSize = 16384;
+
+    std::atomic<Job*> ready { nullptr }, finished { nullptr };
+
+    // the storage whose history the audio thread is copying across (audio thread only)
+    Job* copying = nullptr;
+
+    JUCE_DECLARE_NON_COPYABLE (DelayLineResizer)
+};
@@ -0,0 +1,122 @@
+/*
+  ==============================================================================
+
+    DelayMemoryArena.cpp
+
+  ==============================================================================
+*/
+
+#include "DelayMemoryArena.h"
+
+//==============================================================================
+size_t DelayMemoryArena::getSlabSize (size_t numBytes) noexcept
+{
+    // keeping every slab a whole number of cache lines keeps the next one aligned
+    return (numBytes + alignment - 1) / alignment * alignment;
+}
+
+void* DelayMemoryArena::allocate (size_t numBytes)
+{
+    jassert (numBytes > 0);
+
+    auto slabSize = getSlabSize (numBytes);
+    void* slab = nullptr;
+
+    const juce::ScopedLock sl (lock);
+
+    auto& freeList = freeSlabs[slabSize];
+
+    if (! freeList.empty())
+    {
+        slab = freeList.back();
+        freeList.pop_back();
+    }
+    else
+    {
+        if (slabSize > bytesLeftInChunk)
+        {
+            // whatever's left of the current chunk is too small for this, so it goes to waste
+            auto newChunkSize = juce::jmax (chunkSize, slabSize);
+            std::unique_ptr<char[]> chunk (new (std::nothrow) char[newChunkSize + alignment]);
+
+            if (chunk == nullptr)
+                return nullptr;
+
+            auto address = reinterpret_cast<juce::pointer_sized_uint> (chunk.get());
+            nextFree = chunk.get() + (alignment - address % alignment) % alignment;
+            bytesLeftInChunk = newChunkSize;
+
+            chunks.push_back (std::move (chunk));
+            usage.bytesReserved += newChunkSize;
+        }
+
+        slab = nextFree;
+        nextFree += slabSize;
+        bytesLeftInChunk -= slabSize;
+        ++usage.numSlabs;
+    }
+
+    usage.bytesInUse += slabSize;
+    ++usage.numSlabsInUse;
+
+    return slab;
+}
+
+void DelayMemoryArena::release (void* slab, size_t numBytes) noexcept
+{
+    if (slab == nullptr)
+        return;
+
+    auto slabSize = getSlabSize (numBytes);
+
+    const juce::ScopedLock sl (lock);
+
+    freeSlabs[slabSize].push_back (slab);
+
+    jassert (usage.bytesInUse >= slabSize && usage.numSlabsInUse > 0);
+    usage.bytesInUse -= slabSize;
+    --usage.numSlabsInUse;
+}
+
+DelayMemoryArena::Usage DelayMemoryArena::getUsage() const
+{
+    const juce::ScopedLock sl (lock);
+    return usage;
+}
+
+//==============================================================================
+PooledMemoryBlock::~PooledMemoryBlock()
+{
+    free();
+}
+
+bool PooledMemoryBlock::allocate (size_t numBytes)
+{
+    free();
+
+    if (arena == nullptr)
+        arena = std::make_unique<juce::SharedResourcePointer<DelayMemoryArena>>();
+
+    data = (*arena)->allocate (numBytes);
+
+    if (data == nullptr)
+        return false;
+
+    size = numBytes;
+    return true;
+}
+
+void PooledMemoryBlock::free() noexcept
+{
+    if (data != nullptr)
+        (*arena)->release (data, size);
+
+    data = nullptr;
+    size = 0;
+}
+
+DelayMemoryArena::Usage PooledMemoryBlock::getArenaUsage()
+{
+    juce::SharedResourcePointer<DelayMemoryArena> arena;
+    return arena->getUsage();
+}
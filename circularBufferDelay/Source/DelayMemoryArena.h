@@ -0,0 +1,114 @@
+/*
+  ==============================================================================
+
+    DelayMemoryArena.h
+
+    One pool of delay memory for the whole process, shared by every instance of
+    the plugin, so that loading a big session doesn't mean hundreds of separate
+    large allocations and page faults.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <map>
+#include <memory>
+#include <vector>
+
+//==============================================================================
+/**
+    Hands out cache-line-aligned slabs of memory, carved out of large chunks.
+
+    A slab is handed out uncleared, and whoever takes it clears it: that way
+    the first touch of its pages comes after DelayMemoryResidency has had the
+    chance to ask for huge pages. Released slabs are kept on a free list per
+    size and handed out again: delay lines come in a handful of power-of-two
+    sizes, so after the first few instances most requests are served without
+    asking the system for anything. Nothing goes back to the system until the arena is destroyed,
+    which happens when the last PooledMemoryBlock using it lets go.
+
+    All of this takes a lock, so allocate and release away from the audio thread
+    (CircularDelayLine storage is always built there anyway).
+*/
+class DelayMemoryArena
+{
+public:
+    //==============================================================================
+    DelayMemoryArena() = default;
+
+    /** Every slab starts on a boundary of this many bytes. */
+    static constexpr size_t alignment = 64;
+
+    /** Slabs are carved out of chunks this big; anything larger gets a chunk of its own. */
+    static constexpr size_t chunkSize = 4 * 1024 * 1024;
+
+    /** Returns an uninitialised slab of at least numBytes, or nullptr if the system is out of memory. */
+    void* allocate (size_t numBytes);
+
+    /** Puts a slab back on the free list; numBytes must be what it was allocated with. */
+    void release (void* slab, size_t numBytes) noexcept;
+
+    //==============================================================================
+    struct Usage
+    {
+        size_t bytesReserved = 0;   /**< Everything taken from the system, in chunks. */
+        size_t bytesInUse = 0;      /**< The slabs currently handed out. */
+        int numSlabs = 0;           /**< Slabs carved so far, in use or free. */
+        int numSlabsInUse = 0;
+    };
+
+    /** A snapshot of how much memory the arena holds and how much of it is in use. */
+    Usage getUsage() const;
+
+private:
+    //==============================================================================
+    static size_t getSlabSize (size_t numBytes) noexcept;
+
+    juce::CriticalSection lock;
+    std::vector<std::unique_ptr<char[]>> chunks;
+    char* nextFree = nullptr;
+    size_t bytesLeftInChunk = 0;
+    std::map<size_t, std::vector<void*>> freeSlabs;
+    Usage usage;
+
+    JUCE_DECLARE_NON_COPYABLE (DelayMemoryArena)
+};
+
+//==============================================================================
+/**
+    A slab from the process-wide DelayMemoryArena, with the same allocate() /
+    free() shape as MirroredMemoryBlock so that delay storage can hold either.
+    The first block allocated brings the arena into existence, and the arena
+    lives on for as long as any block holds on to it.
+*/
+class PooledMemoryBlock
+{
+public:
+    //==============================================================================
+    PooledMemoryBlock() = default;
+    ~PooledMemoryBlock();
+
+    /** Releases any previous slab and takes an uninitialised one of numBytes.
+        Returns false, leaving the block empty, if there's no memory left.
+    */
+    bool allocate (size_t numBytes);
+
+    /** Gives the slab back to the arena. */
+    void free() noexcept;
+
+    void* getData() const noexcept          { return data; }
+    size_t getSize() const noexcept         { return size; }
+
+    /** How much the arena shared by all instances holds (all zero if nothing is using it). */
+    static DelayMemoryArena::Usage getArenaUsage();
+
+private:
+    //==============================================================================
+    std::unique_ptr<juce::SharedResourcePointer<DelayMemoryArena>> arena;
+    void* data = nullptr;
+    size_t size = 0;
+
+    JUCE_DECLARE_NON_COPYABLE (PooledMemoryBlock)
+};
@@ -0,0 +1,134 @@
+/*
+  ==============================================================================
+
+    DelayMemoryResidency.cpp
+
+  ==============================================================================
+*/
+
+#include "DelayMemoryResidency.h"
+#include "MirroredMemoryBlock.h"
+
+#include <cstring>
+
+#if JUCE_LINUX || JUCE_MAC
+ #include <sys/mman.h>
+ #include <sys/resource.h>
+#endif
+
+namespace
+{
+    // The whole pages inside a block. A heap block or an arena slab can share the pages at either
+    // end with its neighbours, but the ones in between are its own, so madvise and mlock (which work
+    // on whole pages, and don't count how many times a page has been locked) only ever get these.
+    struct WholePages
+    {
+        WholePages (void* data, size_t numBytes) noexcept
+        {
+            auto pageSize = (juce::pointer_sized_uint) MirroredMemoryBlock::getPageSize();
+            auto first = (reinterpret_cast<juce::pointer_sized_uint> (data) + pageSize - 1) & ~(pageSize - 1);
+            auto end = (reinterpret_cast<juce::pointer_sized_uint> (data) + numBytes) & ~(pageSize - 1);
+
+            start = reinterpret_cast<void*> (first);
+            size = end > first ? (size_t) (end - first) : 0;
+        }
+
+        void* start = nullptr;
+        size_t size = 0;
+    };
+}
+
+//==============================================================================
+bool DelayMemoryResidency::makeResident (void* data, size_t numBytes, const DelayMemoryOptions& options,
+                                         bool clear, int numMappings) noexcept
+{
+    if (data == nullptr || numBytes == 0)
+        return false;
+
+    auto& counters = getCounters();
+
+   #if JUCE_LINUX
+    // this has to come before the pages are first touched to get huge pages straight away;
+    // for memory that's already been touched, khugepaged merges it later
+    if (options.useHugePages && numBytes >= hugePageThreshold)
+    {
+        WholePages pages (data, numBytes);
+
+        if (pages.size > 0 && madvise (pages.start, pages.size, MADV_HUGEPAGE) == 0)
+            ++counters.hugePageRequests;
+    }
+   #endif
+
+    auto pageSize = MirroredMemoryBlock::getPageSize();
+
+    if (clear)
+    {
+        // the first touch of every page, so it's also the prefault
+        std::memset (data, 0, numBytes);
+    }
+
+    if (options.prefault)
+    {
+        // read and write back a byte of every page of every mapping, which faults it in (for writing)
+        // without changing anything (for a cleared block, that's only the other mappings)
+        auto* bytes = static_cast<volatile char*> (data);
+
+        for (size_t offset = clear ? numBytes : 0; offset < numBytes * (size_t) numMappings; offset += pageSize)
+            bytes[offset] = bytes[offset];
+    }
+
+    if (clear || options.prefault)
+        counters.pagesPrefaulted += (juce::int64) ((numBytes + pageSize - 1) / pageSize);
+
+    if (options.lockInMemory)
+    {
+       #if JUCE_LINUX || JUCE_MAC
+        WholePages pages (data, numBytes);
+
+        // (a block too small to have a page of its own has nothing it can lock without locking a neighbour's)
+        if (pages.size == 0)
+            return false;
+
+        if (mlock (pages.start, pages.size) == 0)
+        {
+            counters.bytesLocked += (juce::int64) pages.size;
+            return true;
+        }
+       #endif
+
+        ++counters.lockFailures;
+    }
+
+    return false;
+}
+
+void DelayMemoryResidency::unlock (void* data, size_t numBytes) noexcept
+{
+   #if JUCE_LINUX || JUCE_MAC
+    WholePages pages (data, numBytes);
+    munlock (pages.start, pages.size);
+    getCounters().bytesLocked -= (juce::int64) pages.size;
+   #else
+    juce::ignoreUnused (data, numBytes);
+   #endif
+}
+
+long DelayMemoryResidency::getPageFaultCount() noexcept
+{
+   #if JUCE_LINUX
+    rusage usage;
+    return getrusage (RUSAGE_THREAD, &usage) == 0 ? usage.ru_minflt + usage.ru_majflt : -1;
+   #elif JUCE_MAC
+    // (macOS only counts per process, so other threads' faults get mixed in)
+    rusage usage;
+    return getrusage (RUSAGE_SELF, &usage) == 0 ? usage.ru_minflt + usage.ru_majflt : -1;
+   #else
+    return -1;
+   #endif
+}
+
+DelayMemoryResidency::Counters& DelayMemoryResidency::getCounters() noexcept
+{
+    static Counters counters;
+    return counters;
+}
@@ -0,0 +1,95 @@
+/*
+  ==============================================================================
+
+    DelayMemoryResidency.h
+
+    Makes sure delay memory is really there before the audio thread needs it:
+    every page faulted in up front, optionally locked into RAM and backed by
+    huge pages.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <atomic>
+
+//==============================================================================
+/**
+    How CircularDelayLine storage is made resident once it's been allocated.
+*/
+struct DelayMemoryOptions
+{
+    /** Touch every page while the storage is built, so the first blocks of audio
+        don't take the page faults.
+    */
+    bool prefault = true;
+
+    /** mlock() the memory so it can't be paged out. This needs the process to be
+        allowed to lock that much (see RLIMIT_MEMLOCK); if it isn't, the memory is
+        simply left unlocked and the failure is counted.
+    */
+    bool lockInMemory = false;
+
+    /** On Linux, ask for transparent huge pages for buffers of at least
+        DelayMemoryResidency::hugePageThreshold bytes, which cuts TLB misses
+        when a long delay line is walked through.
+    */
+    bool useHugePages = false;
+};
+
+//==============================================================================
+/**
+    The system calls behind DelayMemoryOptions, and process-wide counters of
+    what they've done.
+*/
+struct DelayMemoryResidency
+{
+    /** Buffers smaller than this (one x86-64 huge page) aren't worth a huge page. */
+    static constexpr size_t hugePageThreshold = 2 * 1024 * 1024;
+
+    /** Applies the options to a block of memory that nothing else is using yet,
+        and that nothing has touched yet either, so that huge pages can be asked
+        for before the pages exist.
+
+        With clear set, the memory is zeroed here, which faults every page in
+        whatever the options say; without it, the memory has to be zero already
+        (fresh from mmap, say) and is only touched if the options ask.
+
+        A block that's mapped numMappings times back to back (numBytes each, as a
+        MirroredMemoryBlock is) has every mapping faulted in, but is locked and
+        counted once, as it's only that much memory.
+
+        Only the whole pages inside the block are locked (and counted, in
+        bytesLocked): the partial pages at either end may belong to its
+        neighbours on the heap or in the arena too, and an unlock() of this
+        block would unlock them for everybody.
+
+        Returns true if the memory ended up locked, in which case unlock() must be
+        called with the same numBytes before it's freed.
+    */
+    static bool makeResident (void* data, size_t numBytes, const DelayMemoryOptions& options,
+                              bool clear, int numMappings = 1) noexcept;
+
+    /** Undoes the lock taken by makeResident(). */
+    static void unlock (void* data, size_t numBytes) noexcept;
+
+    /** The number of page faults the calling thread has taken so far, or -1
+        where that can't be measured. Storage measures this either side of being
+        built, so the faults it absorbs are counted as avoided.
+    */
+    static long getPageFaultCount() noexcept;
+
+    //==============================================================================
+    struct Counters
+    {
+        std::atomic<juce::int64> pagesPrefaulted { 0 };  /**< Pages touched up front. */
+        std::atomic<juce::int64> faultsAvoided { 0 };    /**< Faults taken while building storage instead of on the audio thread. */
+        std::atomic<juce::int64> bytesLocked { 0 };      /**< Currently locked. */
+        std::atomic<juce::int64> lockFailures { 0 };
+        std::atomic<juce::int64> hugePageRequests { 0 };
+    };
+
+    static Counters& getCounters() noexcept;
+};
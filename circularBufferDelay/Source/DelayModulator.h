@@ -0,0 +1,86 @@
+/*
+  ==============================================================================
+
+    DelayModulator.h
+
+    A sine LFO that turns a centre delay and a depth into one delay time per
+    sample, for chorus, flanger and vibrato settings.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <array>
+
+//==============================================================================
+/**
+    Generates per-sample delay times for FractionalDelayReader::readModulated().
+
+    Each channel runs a quarter of a cycle behind the previous one, so a stereo
+    instance gets some width for free. The sine is produced by rotating a phasor
+    that is re-seeded from the exact phase at the start of every fill(), so it
+    costs a couple of multiplies per sample and never drifts.
+*/
+template <typename SampleType, int NumChannels>
+class DelayModulator
+{
+public:
+    //==============================================================================
+    DelayModulator() = default;
+
+    void prepare (double newSampleRate) noexcept
+    {
+        sampleRate = newSampleRate;
+        reset();
+    }
+
+    void reset() noexcept
+    {
+        for (int channel = 0; channel < NumChannels; ++channel)
+            phases[(size_t) channel] = 0.25 * channel;
+    }
+
+    void setRate (double newRateHz) noexcept
+    {
+        jassert (sampleRate > 0.0);
+        phaseIncrement = newRateHz / sampleRate;
+    }
+
+    //==============================================================================
+    /** Writes centre + depth * sin (phase) into delays for numSamples and moves
+        the channel's phase on. Every channel should be filled for the same
+        number of samples per block to keep their phases locked.
+    */
+    void fill (int channel, SampleType* delays, int numSamples, SampleType centre, SampleType depth) noexcept
+    {
+        jassert (juce::isPositiveAndBelow (channel, NumChannels));
+
+        auto& phase = phases[(size_t) channel];
+        auto angle = juce::MathConstants<double>::twoPi * phase;
+        auto step  = juce::MathConstants<double>::twoPi * phaseIncrement;
+
+        auto s = std::sin (angle), c = std::cos (angle);
+        auto stepSin = std::sin (step), stepCos = std::cos (step);
+
+        for (int i = 0; i < numSamples; ++i)
+        {
+            delays[i] = centre + depth * (SampleType) s;
+
+            auto nextS = s * stepCos + c * stepSin;
+            c = c * stepCos - s * stepSin;
+            s = nextS;
+        }
+
+        phase += phaseIncrement * numSamples;
+        phase -= std::floor (phase);
+    }
+
+private:
+    //==============================================================================
+    double sampleRate = 0.0, phaseIncrement = 0.0;
+    std::array<double, NumChannels> phases {};
+
+    JUCE_DECLARE_NON_COPYABLE (DelayModulator)
+};
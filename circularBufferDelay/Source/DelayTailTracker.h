@@ -0,0 +1,171 @@
+/*
+  ==============================================================================
+
+    DelayTailTracker.h
+
+    Works out when a delay has nothing left to play, so that an idle instance
+    can stop processing, and how long its tail is.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <cmath>
+#include <limits>
+#include "CircularDelayLine.h"
+
+//==============================================================================
+/**
+    Decides when a delay can go to sleep, and wakes it up again.
+
+    Everything a delay will ever play back is in its delay line, so there's no
+    need to model how the echoes decay: once the input has been below the
+    threshold, and so has everything written into the line (the input plus
+    whatever fed back), for as long as the longest delay being read, there's
+    nothing audible left to read. From then on the processor can skip its
+    blocks entirely - no reads, no writes - until a block comes in with
+    something above the threshold, which it processes as normal.
+
+    Only the write head stops while asleep, so the silence left in the line is
+    older than it looks, and a delay time that's grown by the time it wakes
+    would read further back than was checked: goToSleep() is the moment to
+    clear the line (see CircularDelayLine::clearLazily()).
+*/
+template <typename SampleType>
+class DelayTailTracker
+{
+public:
+    //==============================================================================
+    /** -100 dB: the level below which a block counts as silent. */
+    static constexpr SampleType defaultThreshold = SampleType (1.0e-5);
+
+    DelayTailTracker() = default;
+
+    void reset() noexcept
+    {
+        numQuietSamples = 0;
+        lastWriteWasQuiet = false;
+        asleep = false;
+    }
+
+    void setThreshold (SampleType newThreshold) noexcept    { threshold = newThreshold; }
+    SampleType getThreshold() const noexcept                { return threshold; }
+
+    bool isAsleep() const noexcept                          { return asleep; }
+
+    //==============================================================================
+    /** True if the next block's input needs looking at: while asleep, to see
+        whether it should wake up, and once what's being written into the line has
+        gone quiet, to see whether the quiet can start counting. While the line is
+        still being written above the threshold the input can't make any
+        difference, so a playing delay doesn't scan it at all.
+    */
+    bool needsInputCheck() const noexcept                   { return asleep || lastWriteWasQuiet; }
+
+    /** True if any of the first numChannels of the buffer has a sample above the
+        threshold in its first numSamples. The buffer needn't be in the same
+        precision as the line.
+    */
+    template <typename BufferSampleType>
+    bool hasSignal (const juce::AudioBuffer<BufferSampleType>& buffer, int numChannels, int numSamples) const noexcept
+    {
+        for (int channel = 0; channel < numChannels; ++channel)
+            if (! isQuiet (buffer.getReadPointer (channel), numSamples, (BufferSampleType) threshold))
+                return true;
+
+        return false;
+    }
+
+    /** True if the numSamples just written to every channel of the line (i.e. the
+        ones before its write head) were all below the threshold. This stops at
+        the first few samples that aren't, so it's cheap on a line that's playing.
+    */
+    template <typename Line>
+    bool wasWriteQuiet (const Line& line, int numSamples) const noexcept
+    {
+        auto quiet = true;
+
+        for (int channel = 0; channel < line.getNumChannels() && quiet; ++channel)
+        {
+            line.getReadRegion (channel, numSamples, numSamples).forEachSegment ([&] (SampleSpan<const SampleType> segment, int)
+            {
+                quiet = quiet && isQuiet (segment.data, segment.size, threshold);
+            });
+        }
+
+        return quiet;
+    }
+
+    //==============================================================================
+    /** Call after processing every block, with whether its input was looked at
+        and found quiet (see needsInputCheck()), whether what it wrote into the
+        line was quiet, and how far back the longest read of the line goes.
+        Returns true once the delay has been quiet for long enough that it can go
+        to sleep, after which the caller should call goToSleep().
+    */
+    bool blockWasProcessed (bool inputWasQuiet, bool writeWasQuiet, int numSamples, int longestDelayInSamples) noexcept
+    {
+        lastWriteWasQuiet = writeWasQuiet;
+        numQuietSamples = inputWasQuiet && writeWasQuiet ? numQuietSamples + numSamples : 0;
+        return numQuietSamples >= (juce::int64) longestDelayInSamples;
+    }
+
+    void goToSleep() noexcept       { asleep = true; }
+
+    /** Call before processing a block after the input has woken the delay. */
+    void wakeUp() noexcept          { reset(); }
+
+    //==============================================================================
+    /** How long, in seconds, a full-scale input takes to die away below the
+        threshold, going round a feedback loop of delaySeconds with this gain,
+        written into the line at inputGain and heard at wetGain. The first echo
+        arrives after one trip; each one after that is feedback times quieter.
+    */
+    static double getTailLengthSeconds (double delaySeconds, double feedback, double inputGain, double wetGain,
+                                        SampleType threshold = defaultThreshold) noexcept
+    {
+        auto firstEcho = std::abs (inputGain * wetGain);
+        feedback = std::abs (feedback);
+
+        if (firstEcho <= (double) threshold || delaySeconds <= 0.0)
+            return 0.0;
+
+        if (feedback <= 0.0)
+            return delaySeconds;
+
+        // (a loop that doesn't lose anything rings forever)
+        if (feedback >= 1.0)
+            return std::numeric_limits<double>::infinity();
+
+        auto numTrips = 1.0 + std::ceil (std::log ((double) threshold / firstEcho) / std::log (feedback));
+        return delaySeconds * juce::jmax (1.0, numTrips);
+    }
+
+private:
+    //==============================================================================
+    // a chunk at a time, so that a scan of anything above the threshold ends almost as soon as it starts
+    static constexpr int quietCheckLength = 64;
+
+    template <typename Type>
+    static bool isQuiet (const Type* data, int numSamples, Type limit) noexcept
+    {
+        for (int start = 0; start < numSamples; start += quietCheckLength)
+        {
+            auto range = juce::FloatVectorOperations::findMinAndMax (data + start, juce::jmin (quietCheckLength, numSamples - start));
+
+            if (juce::jmax (-range.getStart(), range.getEnd()) > limit)
+                return false;
+        }
+
+        return true;
+    }
+
+    SampleType threshold = defaultThreshold;
+    juce::int64 numQuietSamples = 0;
+    bool lastWriteWasQuiet = false;
+    bool asleep = false;
+
+    JUCE_DECLARE_NON_COPYABLE (DelayTailTracker)
+};
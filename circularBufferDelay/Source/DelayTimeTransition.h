@@ -0,0 +1,219 @@
+/*
+  ==============================================================================
+
+    DelayTimeTransition.h
+
+    Keeps the read head from jumping when the delay time changes, either by
+    crossfading to a second read head or by gliding there like a tape machine.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <cmath>
+
+//==============================================================================
+/** What happens to the read head when the delay time changes. */
+enum class DelayTimeChange
+{
+    jump,       /**< Move straight to the new delay (clicks, but costs nothing). */
+    crossfade,  /**< Start a second read head at the new delay and crossfade to it. */
+    tape        /**< Slide the read head to the new delay, bending the pitch on the way. */
+};
+
+//==============================================================================
+/**
+    Tracks the delay time(s) the read side of a delay line should use while it
+    moves from one delay time to another.
+
+    In crossfade mode there are two read heads during a transition: the
+    current one and the incoming one, mixed with an equal-power (sine/cosine)
+    fade over the transition time. If the target moves again mid-fade, the fade
+    finishes first and the next one starts from wherever it ended up, so a
+    transition never costs more than two reads.
+
+    In tape mode there is one read head whose delay ramps linearly to the
+    target over the transition time, so the echoes speed up or slow down while
+    it moves. A new target restarts the ramp from where the head is.
+
+    Nothing happens between transitions: isActive() is false and the caller can
+    take its usual fixed-delay path. Like CircularDelayLine, the pattern per
+    stretch of samples is to use the delays for every channel and then advance()
+    once.
+*/
+template <typename SampleType>
+class DelayTimeTransition
+{
+public:
+    //==============================================================================
+    DelayTimeTransition() = default;
+
+    void prepare (double newSampleRate) noexcept
+    {
+        sampleRate = newSampleRate;
+        reset();
+    }
+
+    /** Forgets the current delay, so the next target is jumped to. */
+    void reset() noexcept
+    {
+        remaining = 0;
+        hasDelay = false;
+    }
+
+    /** Jumps straight to a delay, ending any transition. */
+    void reset (double delayInSamples) noexcept
+    {
+        currentDelay = incomingDelay = targetDelay = delayInSamples;
+        remaining = 0;
+        hasDelay = true;
+    }
+
+    /** Changing the mode mid-transition jumps to the target. */
+    void setMode (DelayTimeChange newMode) noexcept
+    {
+        if (mode != newMode)
+        {
+            mode = newMode;
+
+            if (hasDelay)
+                reset (targetDelay);
+        }
+    }
+
+    DelayTimeChange getMode() const noexcept    { return mode; }
+
+    /** Takes effect from the next transition. */
+    void setTransitionTime (double newTimeInSeconds) noexcept
+    {
+        jassert (sampleRate > 0.0);
+        transitionLength = juce::jmax (1, juce::roundToInt (newTimeInSeconds * sampleRate));
+    }
+
+    /** Where the delay should end up; call it once per block. */
+    void setTargetDelay (double delayInSamples) noexcept
+    {
+        if (! hasDelay || mode == DelayTimeChange::jump)
+        {
+            reset (delayInSamples);
+            return;
+        }
+
+        if (delayInSamples == targetDelay)
+            return;
+
+        targetDelay = delayInSamples;
+
+        // a crossfade that's under way carries on, and picks the new target up when it's done
+        if (mode == DelayTimeChange::tape || remaining == 0)
+            start();
+    }
+
+    //==============================================================================
+    bool isActive() const noexcept          { return remaining > 0; }
+    bool isCrossfading() const noexcept     { return isActive() && mode == DelayTimeChange::crossfade; }
+    bool isGliding() const noexcept         { return isActive() && mode == DelayTimeChange::tape; }
+
+    /** The delay of the (outgoing) read head at the start of the next stretch. */
+    double getCurrentDelay() const noexcept     { return currentDelay; }
+
+    /** The delay of the head being faded in, while crossfading. */
+    double getIncomingDelay() const noexcept    { return incomingDelay; }
+
+    /** The shortest and longest delays any head can reach before the target. */
+    double getShortestDelay() const noexcept    { return juce::jmin (currentDelay, incomingDelay, targetDelay); }
+    double getLongestDelay() const noexcept     { return juce::jmax (currentDelay, incomingDelay, targetDelay); }
+
+    /** Shortens a stretch so it doesn't run past the end of a transition, which
+        keeps every stretch either inside one transition or outside all of them.
+    */
+    int getStretchLength (int maximumLength) const noexcept
+    {
+        return isActive() ? juce::jmin (maximumLength, remaining) : maximumLength;
+    }
+
+    //==============================================================================
+    /** While gliding, adds the ramping delay for the next numSamples to delays
+        (which can already hold an LFO's offsets).
+    */
+    void addGlide (SampleType* delays, int numSamples) const noexcept
+    {
+        jassert (isGliding() && numSamples <= remaining);
+
+        for (int i = 0; i < numSamples; ++i)
+            delays[i] += (SampleType) (currentDelay + glideStep * i);
+    }
+
+    /** While crossfading, mixes the incoming head's samples into the current
+        head's for the next numSamples, leaving the result in current.
+    */
+    void applyCrossfade (SampleType* current, const SampleType* incoming, int numSamples) const noexcept
+    {
+        jassert (isCrossfading() && numSamples <= remaining);
+
+        // the gains are a quarter turn of a phasor, rotated rather than recomputed per sample
+        auto step  = juce::MathConstants<double>::halfPi / transitionLength;
+        auto angle = step * (transitionLength - remaining + 1);
+
+        auto fadeIn = std::sin (angle), fadeOut = std::cos (angle);
+        auto stepSin = std::sin (step), stepCos = std::cos (step);
+
+        for (int i = 0; i < numSamples; ++i)
+        {
+            current[i] = (SampleType) fadeOut * current[i] + (SampleType) fadeIn * incoming[i];
+
+            auto nextFadeIn = fadeIn * stepCos + fadeOut * stepSin;
+            fadeOut = fadeOut * stepCos - fadeIn * stepSin;
+            fadeIn = nextFadeIn;
+        }
+    }
+
+    /** Moves the transition on by numSamples. Returns true when a crossfade has
+        just finished, i.e. the incoming head is now the current one, so the
+        caller can hand over any state it keeps per head.
+    */
+    bool advance (int numSamples) noexcept
+    {
+        if (! isActive())
+            return false;
+
+        jassert (numSamples <= remaining);
+        remaining -= numSamples;
+
+        if (mode == DelayTimeChange::tape)
+        {
+            currentDelay = remaining > 0 ? currentDelay + glideStep * numSamples : targetDelay;
+            return false;
+        }
+
+        if (remaining > 0)
+            return false;
+
+        currentDelay = incomingDelay;
+
+        if (currentDelay != targetDelay)
+            start();
+
+        return true;
+    }
+
+private:
+    //==============================================================================
+    void start() noexcept
+    {
+        remaining = transitionLength;
+        incomingDelay = targetDelay;
+        glideStep = (targetDelay - currentDelay) / transitionLength;
+    }
+
+    //==============================================================================
+    double sampleRate = 44100.0;
+    DelayTimeChange mode = DelayTimeChange::crossfade;
+    double currentDelay = 0.0, incomingDelay = 0.0, targetDelay = 0.0, glideStep = 0.0;
+    int transitionLength = 1, remaining = 0;
+    bool hasDelay = false;
+
+    JUCE_DECLARE_NON_COPYABLE (DelayTimeTransition)
+};
@@ -0,0 +1,506 @@
+/*
+  ==============================================================================
+
+    DiskBackedDelayLine.h
+
+    A delay line whose history mostly lives in a file, for loops and
+    "capture the last hour" delays far longer than anyone wants resident in
+    memory.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "DelayInterpolation.h"
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <vector>
+
+//==============================================================================
+/**
+    Keeps only a hot window of recent history in memory and spills the rest to
+    a temporary file, with a background thread doing all of the file I/O.
+
+    Writes always land in the hot window, an ordinary CircularDelayLine. Each
+    block is also handed to the background thread through a lock-free FIFO
+    (the background thread never looks at the hot window itself, which the
+    audio thread is busy overwriting), and from there it goes out to the
+    file, which holds the whole history as a ring of getMaximumDelay() plus a
+    hot window's worth of samples per channel. If the background thread falls
+    so far behind that the FIFO fills up, blocks are dropped, go to disk as
+    silence and are counted by getNumSamplesLost().
+
+    Delays up to getHotDelayLimit() are read straight from the hot window.
+    Longer ones come from a read cache that the background thread keeps
+    filled from the file, ahead of where the last long read left off. If the
+    samples a read needs aren't in the cache yet (the delay just jumped, or
+    the disk is slow) the read returns silence and counts an underrun rather
+    than wait: the audio thread never touches the file, takes a lock or
+    blocks. The cache catches up within a few of the background thread's
+    polls, so an underrun is a short gap.
+
+    The cache is shared with the background thread through a seqlock: a read
+    copies its samples out, then checks that the window it copied from wasn't
+    moved on underneath it, and throws the copy away (as an underrun) if it
+    was. The cache's samples are relaxed atomics, so a copy that races with
+    the background thread's refill reads stale values rather than being a
+    data race.
+
+    Like CircularDelayLine, write every channel and then advance() once per
+    block. prepare() and release() must not be called while the audio thread
+    is using the line.
+
+    Nothing in the plug-in uses this yet: Max Delay stops at 2 seconds, which
+    a CircularDelayLine holds easily. It's here for a looper or a long capture
+    to build on.
+*/
+template <int NumChannels>
+class DiskBackedDelayLine  : private juce::Thread
+{
+public:
+    //==============================================================================
+    using HotLine = CircularDelayLine<float, NumChannels>;
+
+    /** The hot window's default length: a few seconds, so the background thread
+        can fall a second or more behind before anything is lost.
+    */
+    static constexpr int defaultHotLength = 1 << 18;
+
+    DiskBackedDelayLine()  : juce::Thread ("Disk-backed delay line") {}
+
+    ~DiskBackedDelayLine() override
+    {
+        release();
+    }
+
+    //==============================================================================
+    /** Sets up for delays of up to maximumDelay samples, keeping hotLength of
+        them in memory, and starts the background thread. maximumBlockSize is
+        the most that's written between advance()s and read at once.
+
+        Returns false if the file can't be created, in which case only delays
+        up to getHotDelayLimit() work and longer ones read as silence.
+    */
+    bool prepare (int numChannelsToUse, juce::int64 maximumDelay, int maximumBlockSize, int hotLength = defaultHotLength)
+    {
+        release();
+
+        numChannels = numChannelsToUse;
+        maxBlockSize = maximumBlockSize;
+        historyLength = maximumDelay;
+
+        hot.prepare (numChannels, juce::jmax (hotLength, 4 * (maximumBlockSize + DelayInterpolationKernels::maxTaps)),
+                     HotLine::Backing::plain, DelayInterpolationKernels::maxTaps - 1);
+
+        cacheCapacity = hot.getCapacity();
+        cacheMask = cacheCapacity - 1;
+        fileCapacity = historyLength + hot.getCapacity();
+
+        for (int channel = 0; channel < NumChannels; ++channel)
+        {
+            cache[(size_t) channel].reset (channel < numChannels ? new std::atomic<float>[(size_t) cacheCapacity]() : nullptr);
+            spill[(size_t) channel].assign (channel < numChannels ? (size_t) hot.getCapacity() : 0, 0.0f);
+        }
+
+        spillFifo.setTotalSize (hot.getCapacity());
+        spillResumePosition.store (0);
+        spillDropping = false;
+
+        scratch.assign ((size_t) (maximumBlockSize + DelayInterpolationKernels::maxTaps), 0.0f);
+        ioBuffer.assign ((size_t) ioChunkSize, 0.0f);
+
+        cacheStart.store (0);
+        cacheEnd.store (0);
+        readHead.store (noReadHead);
+        nextReadHead = noReadHead;
+        flushedUpTo = 0;
+        numUnderruns.store (0);
+        numSamplesLost.store (0);
+
+        file = std::make_unique<juce::TemporaryFile> (".delay");
+        output = std::make_unique<juce::FileOutputStream> (file->getFile());
+        input  = std::make_unique<juce::FileInputStream> (file->getFile());
+
+        if (output->failedToOpen() || input->failedToOpen())
+        {
+            output.reset();
+            input.reset();
+            return false;
+        }
+
+        startThread();
+        return true;
+    }
+
+    /** Stops the background thread and deletes the file. */
+    void release()
+    {
+        stopThread (2000);
+
+        input.reset();
+        output.reset();
+        file.reset();
+    }
+
+    //==============================================================================
+    int getNumChannels() const noexcept                 { return numChannels; }
+    juce::int64 getMaximumDelay() const noexcept        { return historyLength; }
+
+    /** Delays up to this long are served from memory and never underrun. */
+    int getHotDelayLimit() const noexcept               { return hot.getCapacity() / 2; }
+
+    /** How many long reads have come back as silence because the cache didn't
+        have their samples yet. Safe to call from any thread.
+    */
+    int getNumUnderruns() const noexcept                { return numUnderruns.load (std::memory_order_relaxed); }
+
+    /** Samples that the background thread couldn't take in time, because it had
+        fallen a whole hot window behind, and so read back as silence once
+        they're past getHotDelayLimit(). Safe to call from any thread.
+    */
+    juce::int64 getNumSamplesLost() const noexcept      { return numSamplesLost.load (std::memory_order_relaxed); }
+
+    //==============================================================================
+    /** Copies numSamples into a channel at the write head, scaled by gain. */
+    void write (int channel, const float* source, int numSamples, float gain = 1.0f) noexcept
+    {
+        hot.write (channel, source, numSamples, gain);
+    }
+
+    /** Fills dest with numSamples from a channel, starting delayInSamples behind
+        the write head (or with silence if that's on disk and not cached yet).
+    */
+    void read (int channel, float* dest, int numSamples, juce::int64 delayInSamples) noexcept
+    {
+        jassert (delayInSamples >= 0 && delayInSamples <= historyLength);
+
+        if (delayInSamples <= getHotDelayLimit())
+            hot.read (channel, dest, numSamples, (int) delayInSamples);
+        else
+            readFromCache (channel, dest, numSamples, hot.getNumSamplesWritten() - delayInSamples);
+    }
+
+    /** Fills dest with numSamples read delayInSamples behind the write head,
+        interpolated by reader.
+    */
+    void readInterpolated (FractionalDelayReader<float, NumChannels>& reader, int channel,
+                           float* dest, int numSamples, double delayInSamples) noexcept
+    {
+        auto oldestTapDelay = (juce::int64) reader.getOldestTapDelay (delayInSamples);
+        jassert (oldestTapDelay <= historyLength);
+
+        if (oldestTapDelay <= getHotDelayLimit())
+        {
+            reader.read (hot, channel, dest, numSamples, delayInSamples);
+            return;
+        }
+
+        if (readFromCache (channel, scratch.data(), numSamples + reader.getNumTaps() - 1,
+                           hot.getNumSamplesWritten() - oldestTapDelay))
+            reader.readContiguous (channel, scratch.data(), dest, numSamples, delayInSamples);
+        else
+            juce::FloatVectorOperations::clear (dest, numSamples);
+    }
+
+    /** Moves the write head on by numSamples, hands the block to the background
+        thread, and tells it where the next long read is expected to start.
+    */
+    void advance (int numSamples) noexcept
+    {
+        spillBlock (numSamples);
+        hot.advance (numSamples);
+
+        if (nextReadHead != noReadHead)
+            readHead.store (nextReadHead + numSamples, std::memory_order_release);
+
+        nextReadHead = noReadHead;
+    }
+
+private:
+    //==============================================================================
+    static constexpr juce::int64 noReadHead = std::numeric_limits<juce::int64>::min();
+    static constexpr int ioChunkSize = 16384;
+    static constexpr int pollIntervalMs = 5;
+
+    /** Copies the samples at absolute positions [start, start + numSamples) out of
+        the read cache. Returns false, leaving dest silent, if they aren't all there.
+    */
+    bool readFromCache (int channel, float* dest, int numSamples, juce::int64 start) noexcept
+    {
+        jassert (numSamples <= (int) scratch.size());
+
+        if (nextReadHead == noReadHead)
+            nextReadHead = start;
+
+        auto generationBefore = generation.load (std::memory_order_acquire);
+        auto end = cacheEnd.load (std::memory_order_acquire);
+
+        if (start >= cacheStart.load (std::memory_order_acquire) && start + numSamples <= end)
+        {
+            const auto* data = cache[(size_t) channel].get();
+
+            for (int i = 0; i < numSamples; ++i)
+                dest[i] = data[(start + i) & cacheMask].load (std::memory_order_relaxed);
+
+            // if the background thread moved the window on while we copied, the copy can't be trusted
+            std::atomic_thread_fence (std::memory_order_acquire);
+
+            if (generation.load (std::memory_order_relaxed) == generationBefore
+                 && start >= cacheStart.load (std::memory_order_relaxed))
+                return true;
+        }
+
+        numUnderruns.fetch_add (1, std::memory_order_relaxed);
+        juce::FloatVectorOperations::clear (dest, numSamples);
+        return false;
+    }
+
+    /** Copies the block just written (before the hot window's write head moves
+        past it) into the FIFO for the background thread. With no room, the block
+        is lost, and so is everything after it until the background thread has
+        emptied the FIFO, so that it can tell where the samples it's given next
+        belong in the history.
+    */
+    void spillBlock (int numSamples) noexcept
+    {
+        if (numSamples <= 0)
+            return;
+
+        if (spillDropping ? spillFifo.getNumReady() > 0 : spillFifo.getFreeSpace() < numSamples)
+        {
+            spillDropping = true;
+            numSamplesLost.fetch_add (numSamples, std::memory_order_relaxed);
+            return;
+        }
+
+        if (spillDropping)
+        {
+            spillResumePosition.store (hot.getNumSamplesWritten(), std::memory_order_release);
+            spillDropping = false;
+        }
+
+        int start1, size1, start2, size2;
+        spillFifo.prepareToWrite (numSamples, start1, size1, start2, size2);
+
+        auto position = hot.getWritePosition();
+        auto mask = hot.getCapacity() - 1;
+
+        for (int channel = 0; channel < numChannels; ++channel)
+        {
+            const auto* data = hot.getChannelPointer (channel);
+            auto* dest = spill[(size_t) channel].data();
+
+            for (int i = 0; i < size1; ++i)
+                dest[start1 + i] = data[(position + i) & mask];
+
+            for (int i = 0; i < size2; ++i)
+                dest[start2 + i] = data[(position + size1 + i) & mask];
+        }
+
+        spillFifo.finishedWrite (size1 + size2);
+    }
+
+    //==============================================================================
+    void run() override
+    {
+        while (! threadShouldExit())
+        {
+            // the audio thread can't wake us, so poll
+            if (! flush() && ! prefetch())
+                wait (pollIntervalMs);
+        }
+    }
+
+    /** Writes the next chunk waiting in the FIFO out to the file. Returns false if
+        there was nothing to write.
+    */
+    bool flush()
+    {
+        int start1, size1, start2, size2;
+        spillFifo.prepareToRead (ioChunkSize, start1, size1, start2, size2);
+
+        auto length = size1 + size2;
+
+        if (length <= 0)
+            return false;
+
+        // after the audio thread has had to drop some blocks, what it sends picks up further on,
+        // and the gap goes to disk as silence (only the last lap of it, as the file is a ring)
+        auto resumePosition = spillResumePosition.load (std::memory_order_acquire);
+
+        if (resumePosition > flushedUpTo)
+        {
+            juce::FloatVectorOperations::clear (ioBuffer.data(), ioChunkSize);
+
+            for (auto position = juce::jmax (flushedUpTo, resumePosition - fileCapacity); position < resumePosition;)
+            {
+                auto numSilent = (int) juce::jmin ((juce::int64) ioChunkSize, resumePosition - position);
+
+                for (int channel = 0; channel < numChannels; ++channel)
+                    writeToFile (channel, position, ioBuffer.data(), numSilent);
+
+                position += numSilent;
+            }
+
+            flushedUpTo = resumePosition;
+        }
+
+        for (int channel = 0; channel < numChannels; ++channel)
+        {
+            const auto* source = spill[(size_t) channel].data();
+
+            std::copy (source + start1, source + start1 + size1, ioBuffer.begin());
+            std::copy (source + start2, source + start2 + size2, ioBuffer.begin() + size1);
+
+            writeToFile (channel, flushedUpTo, ioBuffer.data(), length);
+        }
+
+        spillFifo.finishedRead (length);
+        output->flush();
+        flushedUpTo += length;
+        return true;
+    }
+
+    /** Reads the next chunk ahead of the read head from the file into the cache,
+        restarting the cache at the read head if it has jumped. Returns false if
+        there was nothing to read.
+    */
+    bool prefetch()
+    {
+        auto head = readHead.load (std::memory_order_acquire);
+
+        if (head == noReadHead || input == nullptr)
+            return false;
+
+        auto start = cacheStart.load (std::memory_order_relaxed);
+        auto end   = cacheEnd.load (std::memory_order_relaxed);
+
+        if (head < start || head > end + cacheCapacity / 2)
+        {
+            // the read head jumped: nothing cached is any use, so start again from it
+            generation.store (generation.load (std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            cacheStart.store (head, std::memory_order_relaxed);
+            cacheEnd.store (head, std::memory_order_release);
+            start = end = head;
+        }
+
+        // stay a block short of lapping the read head, and don't read what isn't on disk yet
+        auto target = juce::jmin (flushedUpTo, head + cacheCapacity - maxBlockSize - DelayInterpolationKernels::maxTaps);
+        auto length = (int) juce::jmin ((juce::int64) ioChunkSize, target - end);
+
+        if (length <= 0)
+            return false;
+
+        auto newStart = juce::jmax (start, end + length - cacheCapacity);
+
+        if (newStart != start)
+            cacheStart.store (newStart, std::memory_order_relaxed);
+
+        // a reader that copies any of what's written below is sure to see the window move
+        std::atomic_thread_fence (std::memory_order_release);
+
+        for (int channel = 0; channel < numChannels; ++channel)
+        {
+            readFromFile (channel, end, ioBuffer.data(), length);
+
+            auto* data = cache[(size_t) channel].get();
+
+            for (int i = 0; i < length; ++i)
+                data[(end + i) & cacheMask].store (ioBuffer[(size_t) i], std::memory_order_relaxed);
+        }
+
+        cacheEnd.store (end + length, std::memory_order_release);
+        return true;
+    }
+
+    //==============================================================================
+    /** Each channel is a ring of fileCapacity samples in the file, one after another. */
+    juce::int64 getFileOffset (int channel, juce::int64 position) const noexcept
+    {
+        return ((juce::int64) channel * fileCapacity + position % fileCapacity) * (juce::int64) sizeof (float);
+    }
+
+    void writeToFile (int channel, juce::int64 position, const float* source, int numSamples)
+    {
+        while (numSamples > 0)
+        {
+            auto length = (int) juce::jmin ((juce::int64) numSamples, fileCapacity - position % fileCapacity);
+
+            output->setPosition (getFileOffset (channel, position));
+            output->write (source, (size_t) length * sizeof (float));
+
+            source += length;
+            position += length;
+            numSamples -= length;
+        }
+    }
+
+    void readFromFile (int channel, juce::int64 position, float* dest, int numSamples)
+    {
+        // before the first sample was written there's only silence
+        if (position < 0)
+        {
+            auto numSilent = (int) juce::jmin ((juce::int64) numSamples, -position);
+            juce::FloatVectorOperations::clear (dest, numSilent);
+
+            dest += numSilent;
+            position += numSilent;
+            numSamples -= numSilent;
+        }
+
+        while (numSamples > 0)
+        {
+            auto length = (int) juce::jmin ((juce::int64) numSamples, fileCapacity - position % fileCapacity);
+            auto numBytes = (int) ((size_t) length * sizeof (float));
+
+            input->setPosition (getFileOffset (channel, position));
+            auto numRead = juce::jmax (0, input->read (dest, numBytes));
+
+            // past the end of the file is history that hasn't been written yet
+            std::memset (reinterpret_cast<char*> (dest) + numRead, 0, (size_t) (numBytes - numRead));
+
+            dest += length;
+            position += length;
+            numSamples -= length;
+        }
+    }
+
+    //==============================================================================
+    HotLine hot;
+    int numChannels = 0, maxBlockSize = 0;
+    juce::int64 historyLength = 0, fileCapacity = 0;
+
+    // the read cache: written by the background thread, copied from by the audio thread
+    std::array<std::unique_ptr<std::atomic<float>[]>, NumChannels> cache;
+    int cacheCapacity = 0, cacheMask = 0;
+    std::atomic<juce::int64> cacheStart { 0 }, cacheEnd { 0 };
+    std::atomic<juce::uint32> generation { 0 };
+
+    // what's been written, on its way from the audio thread to the background thread
+    std::array<std::vector<float>, NumChannels> spill;
+    juce::AbstractFifo spillFifo { 1 };
+    std::atomic<juce::int64> spillResumePosition { 0 };
+
+    // audio thread only
+    std::vector<float> scratch;
+    juce::int64 nextReadHead = noReadHead;
+    bool spillDropping = false;
+
+    std::atomic<juce::int64> readHead { noReadHead };
+    std::atomic<int> numUnderruns { 0 };
+    std::atomic<juce::int64> numSamplesLost { 0 };
+
+    // background thread only
+    std::unique_ptr<juce::TemporaryFile> file;
+    std::unique_ptr<juce::FileOutputStream> output;
+    std::unique_ptr<juce::FileInputStream> input;
+    std::vector<float> ioBuffer;
+    juce::int64 flushedUpTo = 0;
+
+    JUCE_DECLARE_NON_COPYABLE (DiskBackedDelayLine)
+};
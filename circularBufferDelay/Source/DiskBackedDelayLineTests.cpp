@@ -0,0 +1,144 @@
+/*
+  ==============================================================================
+
+    DiskBackedDelayLineTests.cpp
+
+    Checks that DiskBackedDelayLine reports its underruns and lost samples
+    honestly: every long read either comes back right or comes back silent
+    and is counted. Registered with JUCE's UnitTestRunner by the static
+    instance at the bottom.
+
+  ==============================================================================
+*/
+
+#include "DiskBackedDelayLine.h"
+
+//==============================================================================
+class DiskBackedDelayLineTests  : public juce::UnitTest
+{
+public:
+    DiskBackedDelayLineTests()  : juce::UnitTest ("DiskBackedDelayLine counters", "Delay") {}
+
+    void runTest() override
+    {
+        beginTest ("A read before the cache has anything is an underrun");
+        {
+            DiskBackedDelayLine<numChannels> line;
+            expect (line.prepare (numChannels, maximumDelay, blockSize, 0));
+
+            writeBlocks (line, 0, 8);
+
+            std::vector<float> dest ((size_t) blockSize, 1.0f);
+            line.read (0, dest.data(), blockSize, line.getHotDelayLimit() + 1);
+
+            expectEquals (line.getNumUnderruns(), 1);
+            expect (isSilent (dest), "an underrun didn't read as silence");
+        }
+
+        beginTest ("Every sample read back from disk is either right or counted as lost");
+        {
+            DiskBackedDelayLine<numChannels> line;
+            expect (line.prepare (numChannels, maximumDelay, blockSize, 0));
+
+            // all at once, far faster than real time, so the background thread may well fall behind...
+            auto position = writeBlocks (line, 0, numBurstBlocks);
+
+            // ...then slowly enough that it certainly catches up before anything read from memory is written
+            juce::Thread::sleep (200);
+            position = writeBlocks (line, position, line.getHotDelayLimit() / blockSize + 2);
+
+            auto numLostWhileWriting = line.getNumSamplesLost();
+            auto oldestFromMemory = position - line.getHotDelayLimit();
+            juce::int64 numSilent = 0;
+            auto numWrong = 0;
+
+            std::vector<float> dest ((size_t) blockSize);
+
+            for (juce::int64 start = 0; start + blockSize <= oldestFromMemory; start += blockSize)
+            {
+                for (int channel = 0; channel < numChannels; ++channel)
+                {
+                    if (! readWhenCached (line, channel, dest, position - start))
+                    {
+                        ++numWrong;
+                        continue;
+                    }
+
+                    if (isSilent (dest))
+                    {
+                        if (channel == 0)
+                            numSilent += blockSize;
+
+                        continue;
+                    }
+
+                    for (int i = 0; i < blockSize; ++i)
+                        if (dest[(size_t) i] != valueAt (start + i, channel))
+                            ++numWrong;
+                }
+            }
+
+            expectEquals (numWrong, 0, "samples read back from disk were wrong");
+            expectEquals (line.getNumSamplesLost(), numLostWhileWriting, "samples were lost while only reading");
+            expectEquals (numSilent, numLostWhileWriting, "silence read back doesn't match the samples counted as lost");
+        }
+    }
+
+private:
+    //==============================================================================
+    static constexpr int numChannels = 2;
+    static constexpr int blockSize = 256;
+    static constexpr int numBurstBlocks = 400;
+    static constexpr juce::int64 maximumDelay = 1 << 18;
+
+    // distinct for every sample of every channel, never zero, and exact as a float
+    static float valueAt (juce::int64 position, int channel)
+    {
+        return (float) (1 + position * numChannels + channel);
+    }
+
+    static bool isSilent (const std::vector<float>& samples)
+    {
+        return std::all_of (samples.begin(), samples.end(), [] (float sample) { return sample == 0.0f; });
+    }
+
+    static juce::int64 writeBlocks (DiskBackedDelayLine<numChannels>& line, juce::int64 position, int numBlocks)
+    {
+        std::vector<float> block ((size_t) blockSize);
+
+        for (int b = 0; b < numBlocks; ++b, position += blockSize)
+        {
+            for (int channel = 0; channel < numChannels; ++channel)
+            {
+                for (int i = 0; i < blockSize; ++i)
+                    block[(size_t) i] = valueAt (position + i, channel);
+
+                line.write (channel, block.data(), blockSize);
+            }
+
+            line.advance (blockSize);
+        }
+
+        return position;
+    }
+
+    // keeps asking (the way an audio thread would, a block at a time) until the cache has the samples
+    static bool readWhenCached (DiskBackedDelayLine<numChannels>& line, int channel, std::vector<float>& dest, juce::int64 delay)
+    {
+        for (int attempt = 0; attempt < 2000; ++attempt)
+        {
+            auto underrunsBefore = line.getNumUnderruns();
+            line.read (channel, dest.data(), blockSize, delay);
+            line.advance (0);
+
+            if (line.getNumUnderruns() == underrunsBefore)
+                return true;
+
+            juce::Thread::sleep (1);
+        }
+
+        return false;
+    }
+};
+
+static DiskBackedDelayLineTests diskBackedDelayLineTests;
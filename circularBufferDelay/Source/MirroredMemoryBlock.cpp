@@ -0,0 +1,116 @@
+/*
+  ==============================================================================
+
+    MirroredMemoryBlock.cpp
+
+  ==============================================================================
+*/
+
+#include "MirroredMemoryBlock.h"
+
+#if JUCE_LINUX
+ #include <sys/mman.h>
+ #include <unistd.h>
+#endif
+
+//==============================================================================
+MirroredMemoryBlock::~MirroredMemoryBlock()
+{
+    free();
+}
+
+#if JUCE_LINUX
+
+bool MirroredMemoryBlock::allocate (size_t numBytes)
+{
+    free();
+
+    jassert (numBytes > 0 && numBytes % getPageSize() == 0);
+
+    if (numBytes == 0 || numBytes % getPageSize() != 0)
+        return false;
+
+    auto fd = memfd_create ("CircularDelayLine", MFD_CLOEXEC);
+
+    if (fd < 0)
+        return false;
+
+    if (ftruncate (fd, (off_t) numBytes) != 0)
+    {
+        close (fd);
+        return false;
+    }
+
+    // Reserve the whole double-sized range first so that nothing else can be
+    // mapped into the second half while we're setting it up
+    auto* reserved = mmap (nullptr, numBytes * 2, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (reserved == MAP_FAILED)
+    {
+        close (fd);
+        return false;
+    }
+
+    auto* base   = static_cast<char*> (reserved);
+    auto* first  = mmap (base,            numBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0);
+    auto* second = mmap (base + numBytes, numBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0);
+
+    // the mappings keep the memory alive, so the descriptor isn't needed any more
+    close (fd);
+
+    if (first != base || second != base + numBytes)
+    {
+        munmap (reserved, numBytes * 2);
+        return false;
+    }
+
+    data = reserved;
+    size = numBytes;
+    return true;
+}
+
+void MirroredMemoryBlock::free() noexcept
+{
+    if (data != nullptr)
+        munmap (data, size * 2);
+
+    data = nullptr;
+    size = 0;
+}
+
+bool MirroredMemoryBlock::isSupported() noexcept
+{
+    return true;
+}
+
+size_t MirroredMemoryBlock::getPageSize() noexcept
+{
+    static const auto pageSize = (size_t) sysconf (_SC_PAGESIZE);
+    return pageSize;
+}
+
+#else
+
+bool MirroredMemoryBlock::allocate (size_t)
+{
+    free();
+    return false;
+}
+
+void MirroredMemoryBlock::free() noexcept
+{
+    data = nullptr;
+    size = 0;
+}
+
+bool MirroredMemoryBlock::isSupported() noexcept
+{
+    return false;
+}
+
+size_t MirroredMemoryBlock::getPageSize() noexcept
+{
+    return 4096;
+}
+
+#endif
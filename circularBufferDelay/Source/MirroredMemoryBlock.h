@@ -0,0 +1,60 @@
+/*
+  ==============================================================================
+
+    MirroredMemoryBlock.h
+
+    A block of memory mapped twice, back to back, so that a ring buffer stored
+    in it can be read or written past its end without ever wrapping.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+//==============================================================================
+/**
+    Owns size bytes of physical memory that appear at two consecutive virtual
+    address ranges: getData()[i] and getData()[i + getSize()] are the same byte.
+
+    This relies on memfd_create and mmap, so it's only available on Linux. On
+    other platforms, or if the kernel refuses the mapping, allocate() returns
+    false and callers should fall back to an ordinary buffer.
+*/
+class MirroredMemoryBlock
+{
+public:
+    //==============================================================================
+    MirroredMemoryBlock() = default;
+    ~MirroredMemoryBlock();
+
+    /** Releases any previous mapping and maps numBytes twice. numBytes must be a
+        non-zero multiple of getPageSize(). The memory starts out zeroed.
+        Returns false, leaving the block empty, if the mapping can't be made.
+    */
+    bool allocate (size_t numBytes);
+
+    /** Unmaps the memory. */
+    void free() noexcept;
+
+    /** Returns the start of the first of the two mappings, or nullptr. */
+    void* getData() const noexcept          { return data; }
+
+    /** Returns the size of one mapping, i.e. the amount of real memory. */
+    size_t getSize() const noexcept         { return size; }
+
+    //==============================================================================
+    /** True if this platform can create mirrored mappings at all. */
+    static bool isSupported() noexcept;
+
+    /** The granularity that allocate() sizes must be a multiple of. */
+    static size_t getPageSize() noexcept;
+
+private:
+    //==============================================================================
+    void* data = nullptr;
+    size_t size = 0;
+
+    JUCE_DECLARE_NON_COPYABLE (MirroredMemoryBlock)
+};
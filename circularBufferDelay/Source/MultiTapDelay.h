@@ -0,0 +1,554 @@
+/*
+  ==============================================================================
+
+    MultiTapDelay.h
+
+    Up to 32 extra read heads on a CircularDelayLine, each with its own time,
+    gain, pan and lowpass, evaluated together rather than one after another.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "CircularDelayLine.h"
+#include "DelayKernelDispatch.h"
+
+//==============================================================================
+/**
+    The inner loop behind MultiTapDelay, laid out across taps rather than across
+    time: for every output sample, a whole group of taps gathers its delayed
+    samples, runs its one-pole lowpass and adds into the output together.
+    Each tap's filter is recursive in time, but the taps are independent of
+    each other, so they fill the SIMD lanes instead.
+
+    All arrays are structure-of-arrays, numTaps long, padded to a multiple of
+    paddedTapGroup with taps whose gain is zero.
+*/
+struct MultiTapKernels
+{
+    static constexpr int paddedTapGroup = 8;
+
+    template <typename SampleType>
+    static void processScalar (const SampleType* data, int mask, int position,
+                               const int* delays, const SampleType* gains, const SampleType* coefficients,
+                               SampleType* states, int numTaps, SampleType* output, int numSamples, SampleType outputGain) noexcept
+    {
+        DELAY_KERNEL_NO_FP_CONTRACT
+
+        for (int i = 0; i < numSamples; ++i)
+        {
+            auto sum = SampleType();
+
+            for (int k = 0; k < numTaps; ++k)
+            {
+                auto x = data[(position + i - delays[k]) & mask];
+                states[k] += coefficients[k] * (x - states[k]);
+                sum += gains[k] * states[k];
+            }
+
+            output[i] += outputGain * sum;
+        }
+    }
+
+    /** processScalar(), but with tap k reading silence for its first firstFresh[k]
+        samples: the path for while a lazy clear has left stale history.
+    */
+    template <typename SampleType>
+    static void processScalarSkippingStale (const SampleType* data, int mask, int position,
+                                            const int* delays, const int* firstFresh, const SampleType* gains, const SampleType* coefficients,
+                                            SampleType* states, int numTaps, SampleType* output, int numSamples, SampleType outputGain) noexcept
+    {
+        DELAY_KERNEL_NO_FP_CONTRACT
+
+        for (int i = 0; i < numSamples; ++i)
+        {
+            auto sum = SampleType();
+
+            for (int k = 0; k < numTaps; ++k)
+            {
+                auto x = i < firstFresh[k] ? SampleType() : data[(position + i - delays[k]) & mask];
+                states[k] += coefficients[k] * (x - states[k]);
+                sum += gains[k] * states[k];
+            }
+
+            output[i] += outputGain * sum;
+        }
+    }
+
+   #if JUCE_USE_SSE_INTRINSICS
+    static void processSSE (const float* data, int mask, int position,
+                            const int* delays, const float* gains, const float* coefficients,
+                            float* states, int numTaps, float* output, int numSamples, float outputGain) noexcept
+    {
+        constexpr int maxGroups = 32 / 4;
+        auto numGroups = numTaps / 4;
+        jassert (numGroups <= maxGroups && numTaps % 4 == 0);
+
+        __m128i d[maxGroups];
+        __m128 g[maxGroups], c[maxGroups], s[maxGroups];
+
+        for (int group = 0; group < numGroups; ++group)
+        {
+            d[group] = _mm_loadu_si128 (reinterpret_cast<const __m128i*> (delays + group * 4));
+            g[group] = _mm_loadu_ps (gains + group * 4);
+            c[group] = _mm_loadu_ps (coefficients + group * 4);
+            s[group] = _mm_loadu_ps (states + group * 4);
+        }
+
+        auto maskV = _mm_set1_epi32 (mask);
+
+        for (int i = 0; i < numSamples; ++i)
+        {
+            auto now = _mm_set1_epi32 (position + i);
+            auto sum = _mm_setzero_ps();
+
+            for (int group = 0; group < numGroups; ++group)
+            {
+                alignas (16) int index[4];
+                _mm_store_si128 (reinterpret_cast<__m128i*> (index), _mm_and_si128 (_mm_sub_epi32 (now, d[group]), maskV));
+
+                auto x = _mm_setr_ps (data[index[0]], data[index[1]], data[index[2]], data[index[3]]);
+                s[group] = _mm_add_ps (s[group], _mm_mul_ps (c[group], _mm_sub_ps (x, s[group])));
+                sum = _mm_add_ps (sum, _mm_mul_ps (g[group], s[group]));
+            }
+
+            // horizontal add of the four lanes
+            sum = _mm_add_ps (sum, _mm_movehl_ps (sum, sum));
+            sum = _mm_add_ss (sum, _mm_shuffle_ps (sum, sum, 1));
+            output[i] += outputGain * _mm_cvtss_f32 (sum);
+        }
+
+        for (int group = 0; group < numGroups; ++group)
+            _mm_storeu_ps (states + group * 4, s[group]);
+    }
+
+    DELAY_KERNEL_TARGET_AVX2
+    static void processAVX2 (const float* data, int mask, int position,
+                             const int* delays, const float* gains, const float* coefficients,
+                             float* states, int numTaps, float* output, int numSamples, float outputGain) noexcept
+    {
+        constexpr int maxGroups = 32 / 8;
+        auto numGroups = numTaps / 8;
+        jassert (numGroups <= maxGroups && numTaps % 8 == 0);
+
+        __m256i d[maxGroups];
+        __m256 g[maxGroups], c[maxGroups], s[maxGroups];
+
+        for (int group = 0; group < numGroups; ++group)
+        {
+            d[group] = _mm256_loadu_si256 (reinterpret_cast<const __m256i*> (delays + group * 8));
+            g[group] = _mm256_loadu_ps (gains + group * 8);
+            c[group] = _mm256_loadu_ps (coefficients + group * 8);
+            s[group] = _mm256_loadu_ps (states + group * 8);
+        }
+
+        auto maskV = _mm256_set1_epi32 (mask);
+
+        for (int i = 0; i < numSamples; ++i)
+        {
+            auto now = _mm256_set1_epi32 (position + i);
+            auto sum = _mm256_setzero_ps();
+
+            for (int group = 0; group < numGroups; ++group)
+            {
+                auto x = _mm256_i32gather_ps (data, _mm256_and_si256 (_mm256_sub_epi32 (now, d[group]), maskV), 4);
+                s[group] = _mm256_add_ps (s[group], _mm256_mul_ps (c[group], _mm256_sub_ps (x, s[group])));
+                sum = _mm256_add_ps (sum, _mm256_mul_ps (g[group], s[group]));
+            }
+
+            auto half = _mm_add_ps (_mm256_castps256_ps128 (sum), _mm256_extractf128_ps (sum, 1));
+            half = _mm_add_ps (half, _mm_movehl_ps (half, half));
+            half = _mm_add_ss (half, _mm_shuffle_ps (half, half, 1));
+            output[i] += outputGain * _mm_cvtss_f32 (half);
+        }
+
+        for (int group = 0; group < numGroups; ++group)
+            _mm256_storeu_ps (states + group * 8, s[group]);
+    }
+
+    /** Sixteen taps to a group, and with taps only padded to eight, a last group of eight if there's one left over. */
+    DELAY_KERNEL_TARGET_AVX512
+    static void processAVX512 (const float* data, int mask, int position,
+                               const int* delays, const float* gains, const float* coefficients,
+                               float* states, int numTaps, float* output, int numSamples, float outputGain) noexcept
+    {
+        constexpr int maxGroups = 32 / 16;
+        auto numGroups = numTaps / 16;
+        auto hasHalfGroup = numTaps % 16 != 0;
+        jassert (numGroups <= maxGroups && numTaps % 8 == 0);
+
+        __m512i d[maxGroups];
+        __m512 g[maxGroups], c[maxGroups], s[maxGroups];
+
+        for (int group = 0; group < numGroups; ++group)
+        {
+            d[group] = _mm512_loadu_si512 (delays + group * 16);
+            g[group] = _mm512_loadu_ps (gains + group * 16);
+            c[group] = _mm512_loadu_ps (coefficients + group * 16);
+            s[group] = _mm512_loadu_ps (states + group * 16);
+        }
+
+        auto last = numGroups * 16;
+        auto dLast = _mm256_setzero_si256();
+        auto gLast = _mm256_setzero_ps(), cLast = _mm256_setzero_ps(), sLast = _mm256_setzero_ps();
+
+        if (hasHalfGroup)
+        {
+            dLast = _mm256_loadu_si256 (reinterpret_cast<const __m256i*> (delays + last));
+            gLast = _mm256_loadu_ps (gains + last);
+            cLast = _mm256_loadu_ps (coefficients + last);
+            sLast = _mm256_loadu_ps (states + last);
+        }
+
+        auto maskV = _mm512_set1_epi32 (mask);
+        auto maskHalf = _mm256_set1_epi32 (mask);
+
+        for (int i = 0; i < numSamples; ++i)
+        {
+            auto now = _mm512_set1_epi32 (position + i);
+            auto sum = _mm512_setzero_ps();
+
+            for (int group = 0; group < numGroups; ++group)
+            {
+                auto x = _mm512_i32gather_ps (_mm512_and_epi32 (_mm512_sub_epi32 (now, d[group]), maskV), data, 4);
+                s[group] = _mm512_add_ps (s[group], _mm512_mul_ps (c[group], _mm512_sub_ps (x, s[group])));
+                sum = _mm512_add_ps (sum, _mm512_mul_ps (g[group], s[group]));
+            }
+
+            auto total = _mm512_reduce_add_ps (sum);
+
+            if (hasHalfGroup)
+            {
+                auto x = _mm256_i32gather_ps (data, _mm256_and_si256 (_mm256_sub_epi32 (_mm256_set1_epi32 (position + i), dLast), maskHalf), 4);
+                sLast = _mm256_add_ps (sLast, _mm256_mul_ps (cLast, _mm256_sub_ps (x, sLast)));
+
+                auto halfSum = _mm256_mul_ps (gLast, sLast);
+                auto quarter = _mm_add_ps (_mm256_castps256_ps128 (halfSum), _mm256_extractf128_ps (halfSum, 1));
+                quarter = _mm_add_ps (quarter, _mm_movehl_ps (quarter, quarter));
+                quarter = _mm_add_ss (quarter, _mm_shuffle_ps (quarter, quarter, 1));
+                total += _mm_cvtss_f32 (quarter);
+            }
+
+            output[i] += outputGain * total;
+        }
+
+        for (int group = 0; group < numGroups; ++group)
+            _mm512_storeu_ps (states + group * 16, s[group]);
+
+        if (hasHalfGroup)
+            _mm256_storeu_ps (states + last, sLast);
+    }
+   #endif
+
+    static void process (const float* data, int mask, int position,
+                         const int* delays, const float* gains, const float* coefficients,
+                         float* states, int numTaps, float* output, int numSamples, float outputGain) noexcept
+    {
+        DelayKernelDispatch::getKernels().multiTap (data, mask, position, delays, gains, coefficients, states, numTaps, output, numSamples, outputGain);
+    }
+
+    static void process (const double* data, int mask, int position,
+                         const int* delays, const double* gains, const double* coefficients,
+                         double* states, int numTaps, double* output, int numSamples, double outputGain) noexcept
+    {
+        processScalar (data, mask, position, delays, gains, coefficients, states, numTaps, output, numSamples, outputGain);
+    }
+};
+
+//==============================================================================
+/**
+    A bank of read heads on one CircularDelayLine, so several echoes share a
+    single write stream instead of each needing its own buffer.
+
+    Taps are kept sorted by delay, so the lanes of each SIMD group read
+    neighbouring stretches of delay memory and tend to share cache lines.
+    Pan is applied as a per-channel gain: each channel's taps read that
+    channel's history, so a mono source pans properly and a stereo one keeps
+    its image. Prepared for a single channel, there's nowhere to pan to, and
+    every tap plays at its own gain.
+
+    A new set of taps doesn't jump in: the old and the new sets both play
+    for fadeSeconds while one crossfades into the other, so taps can be
+    automated without clicks. A tap that's in both sets (the same index in
+    the array given to setTaps()) carries its filter on from the old set;
+    only taps that have just appeared start from silence. A change that
+    comes in during a crossfade is picked up when it's done.
+*/
+template <typename SampleType, int NumChannels>
+class MultiTapDelay
+{
+public:
+    //==============================================================================
+    static constexpr int maxTaps = 32;
+
+    /** How long a change of taps takes to crossfade in. */
+    static constexpr double fadeSeconds = 0.02;
+
+    struct Tap
+    {
+        int delayInSamples = 1;                 /**< At least 1. */
+        SampleType gain = SampleType (1);
+        SampleType pan = SampleType();          /**< -1 (left) to 1 (right). */
+        SampleType cutoffHz = SampleType (20000);
+
+        bool operator== (const Tap& other) const noexcept
+        {
+            return delayInSamples == other.delayInSamples && gain == other.gain
+                && pan == other.pan && cutoffHz == other.cutoffHz;
+        }
+    };
+
+    //==============================================================================
+    MultiTapDelay() = default;
+
+    void prepare (double newSampleRate, int numChannelsToUse = NumChannels) noexcept
+    {
+        jassert (numChannelsToUse > 0 && numChannelsToUse <= NumChannels);
+
+        sampleRate = newSampleRate;
+        numChannels = juce::jlimit (1, NumChannels, numChannelsToUse);
+        fadeLength = juce::jmax (1, juce::roundToInt (fadeSeconds * sampleRate));
+
+        numTaps = numPlaying = 0;
+        taps.fill ({});
+        playing.fill ({});
+
+        for (auto& bank : banks)
+            bank = {};
+
+        fading = false;
+    }
+
+    /** Clears the taps' filter state, and finishes any crossfade at once. */
+    void reset() noexcept
+    {
+        for (auto& bank : banks)
+            for (auto& channelStates : bank.states)
+                channelStates.fill (SampleType());
+
+        fading = false;
+    }
+
+    /** Sets the taps to crossfade to. Doesn't allocate, so it's fine to call
+        from the audio thread, every block; if nothing has changed it does
+        nothing at all.
+    */
+    void setTaps (const Tap* newTaps, int numNewTaps) noexcept
+    {
+        jassert (numNewTaps >= 0 && numNewTaps <= maxTaps);
+        numNewTaps = juce::jmin (numNewTaps, maxTaps);
+
+        numTaps = numNewTaps;
+        std::copy (newTaps, newTaps + numTaps, taps.begin());
+
+        if (! fading && ! isPlayingTarget())
+            startFade();
+    }
+
+    /** The number of taps last set (which may still be fading in). */
+    int getNumTaps() const noexcept         { return numTaps; }
+
+    /** True if there's anything to play: taps, or taps fading out. */
+    bool isActive() const noexcept          { return banks[(size_t) current].numTaps > 0 || fading; }
+
+    /** The longest delay any tap playing reads, including ones fading out. */
+    int getLongestDelay() const noexcept
+    {
+        return fading ? juce::jmax (banks[0].longestDelay, banks[1].longestDelay)
+                      : banks[(size_t) current].longestDelay;
+    }
+
+    //==============================================================================
+    /** Adds the taps of one channel, scaled by outputGain, into output for
+        numSamples. Output sample i is taken relative to position blockStart + i
+        of the line, where blockStart is the write position the block started at;
+        all of the block must already have been written. Call advance() once
+        every channel has been done. A block that's done in stretches passes
+        how far into the block each stretch starts as offsetInBlock, so that a
+        crossfade carries on from the right place.
+    */
+    void process (const CircularDelayLine<SampleType, NumChannels>& line, int channel,
+                  SampleType* output, int numSamples, int blockStart, SampleType outputGain,
+                  int offsetInBlock = 0) noexcept
+    {
+        auto& incoming = banks[(size_t) current];
+
+        if (! fading)
+        {
+            processBank (incoming, line, channel, output, numSamples, blockStart, outputGain);
+            return;
+        }
+
+        // both sets play into scratch buffers a chunk at a time, and the crossfade adds them into the output
+        auto& outgoing = banks[(size_t) (1 - current)];
+
+        for (int offset = 0; offset < numSamples; offset += fadeChunk)
+        {
+            auto length = juce::jmin (fadeChunk, numSamples - offset);
+            auto position = (blockStart + offset) & (line.getCapacity() - 1);
+
+            std::fill (fadeOut.begin(), fadeOut.begin() + length, SampleType());
+            std::fill (fadeIn.begin(), fadeIn.begin() + length, SampleType());
+            processBank (outgoing, line, channel, fadeOut.data(), length, position, SampleType (1));
+            processBank (incoming, line, channel, fadeIn.data(), length, position, SampleType (1));
+
+            for (int i = 0; i < length; ++i)
+            {
+                auto t = juce::jmin (SampleType (1), (SampleType) (fadePosition + offsetInBlock + offset + i + 1) / (SampleType) fadeLength);
+                output[offset + i] += outputGain * (fadeOut[(size_t) i] + t * (fadeIn[(size_t) i] - fadeOut[(size_t) i]));
+            }
+        }
+    }
+
+    /** Moves any crossfade on by numSamples, after every channel of a block
+        has been through process(), and starts the next one if the taps have
+        changed again in the meantime.
+    */
+    void advance (int numSamples) noexcept
+    {
+        if (! fading)
+            return;
+
+        fadePosition += numSamples;
+
+        if (fadePosition >= fadeLength)
+        {
+            fading = false;
+
+            if (! isPlayingTarget())
+                startFade();
+        }
+    }
+
+private:
+    //==============================================================================
+    /** One set of taps, sorted by delay, with its filters. */
+    struct Bank
+    {
+        int numTaps = 0, longestDelay = 0;
+        alignas (32) std::array<int, maxTaps> delays {};
+        alignas (32) std::array<SampleType, maxTaps> coefficients {};
+        alignas (32) std::array<std::array<SampleType, maxTaps>, NumChannels> gains {}, states {};
+        std::array<int, maxTaps> tapIndex {};   // which of the taps given to setTaps() each slot plays
+    };
+
+    static constexpr int fadeChunk = 256;
+
+    bool isPlayingTarget() const noexcept
+    {
+        return numTaps == numPlaying && std::equal (taps.begin(), taps.begin() + numTaps, playing.begin());
+    }
+
+    // builds the other bank from the taps last set, and crossfades to it
+    void startFade() noexcept
+    {
+        const auto& outgoing = banks[(size_t) current];
+        auto& incoming = banks[(size_t) (1 - current)];
+
+        // where each tap was in the bank that's playing, if it was there at all
+        std::array<int, maxTaps> outgoingSlot;
+        outgoingSlot.fill (-1);
+
+        for (int slot = 0; slot < outgoing.numTaps; ++slot)
+            outgoingSlot[(size_t) outgoing.tapIndex[(size_t) slot]] = slot;
+
+        std::array<int, maxTaps> order;
+
+        for (int k = 0; k < maxTaps; ++k)
+            order[(size_t) k] = k;
+
+        std::sort (order.begin(), order.begin() + numTaps,
+                   [this] (int a, int b) { return taps[(size_t) a].delayInSamples < taps[(size_t) b].delayInSamples; });
+
+        incoming.numTaps = numTaps;
+        incoming.longestDelay = 0;
+
+        for (int slot = 0; slot < maxTaps; ++slot)
+        {
+            auto active = slot < numTaps;
+            auto index = order[(size_t) slot];
+            const auto& tap = taps[(size_t) index];
+
+            incoming.tapIndex[(size_t) slot] = index;
+            incoming.delays[(size_t) slot] = active ? juce::jmax (1, tap.delayInSamples) : 1;
+            incoming.coefficients[(size_t) slot] = active ? (SampleType) (1.0 - std::exp (-juce::MathConstants<double>::twoPi
+                                                                                         * juce::jmin ((double) tap.cutoffHz, 0.49 * sampleRate)
+                                                                                         / sampleRate))
+                                                        : SampleType();
+
+            // equal-power pan, folded into each channel's gain
+            auto angle = (juce::jlimit (-1.0, 1.0, (double) tap.pan) + 1.0) * juce::MathConstants<double>::pi / 4.0;
+            auto previousSlot = active ? outgoingSlot[(size_t) index] : -1;
+
+            for (int channel = 0; channel < NumChannels; ++channel)
+            {
+                auto panGain = numChannels == 1 ? 1.0 : (channel == 0 ? std::cos (angle) : std::sin (angle));
+                incoming.gains[(size_t) channel][(size_t) slot] = active ? (SampleType) (tap.gain * panGain) : SampleType();
+
+                // a tap that carries on keeps its filter going; a new one starts from silence
+                incoming.states[(size_t) channel][(size_t) slot] = previousSlot >= 0 ? outgoing.states[(size_t) channel][(size_t) previousSlot]
+                                                                                     : SampleType();
+            }
+
+            if (active)
+                incoming.longestDelay = juce::jmax (incoming.longestDelay, incoming.delays[(size_t) slot]);
+        }
+
+        numPlaying = numTaps;
+        std::copy (taps.begin(), taps.begin() + numTaps, playing.begin());
+
+        current = 1 - current;
+        fadePosition = 0;
+        fading = true;
+    }
+
+    void processBank (Bank& bank, const CircularDelayLine<SampleType, NumChannels>& line, int channel,
+                      SampleType* output, int numSamples, int blockStart, SampleType outputGain) noexcept
+    {
+        if (bank.numTaps == 0)
+            return;
+
+        auto numPadded = (bank.numTaps + MultiTapKernels::paddedTapGroup - 1) / MultiTapKernels::paddedTapGroup
+                           * MultiTapKernels::paddedTapGroup;
+
+        auto* states = bank.states[(size_t) channel].data();
+
+        if (line.hasStaleHistory())
+        {
+            // the taps that still reach back to before a lazy clear read silence until they're past it
+            std::array<int, maxTaps> firstFresh;
+            auto blockDelay = (line.getWritePosition() - blockStart) & (line.getCapacity() - 1);
+
+            for (int k = 0; k < numPadded; ++k)
+                firstFresh[(size_t) k] = line.getNumStaleSamples (numSamples, blockDelay + bank.delays[(size_t) k]);
+
+            MultiTapKernels::processScalarSkippingStale (line.getChannelPointer (channel), line.getCapacity() - 1, blockStart,
+                                                         bank.delays.data(), firstFresh.data(), bank.gains[(size_t) channel].data(),
+                                                         bank.coefficients.data(), states, numPadded, output, numSamples, outputGain);
+            return;
+        }
+
+        MultiTapKernels::process (line.getChannelPointer (channel), line.getCapacity() - 1, blockStart,
+                                  bank.delays.data(), bank.gains[(size_t) channel].data(), bank.coefficients.data(),
+                                  states, numPadded, output, numSamples, outputGain);
+    }
+
+    //==============================================================================
+    double sampleRate = 44100.0;
+    int numChannels = NumChannels;
+
+    // the taps last set, and the ones the current bank was built from
+    int numTaps = 0, numPlaying = 0;
+    std::array<Tap, maxTaps> taps, playing;
+
+    std::array<Bank, 2> banks;
+    int current = 0;
+
+    bool fading = false;
+    int fadeLength = 1, fadePosition = 0;
+    alignas (32) std::array<SampleType, fadeChunk> fadeOut {}, fadeIn {};
+
+    JUCE_DECLARE_NON_COPYABLE (MultiTapDelay)
+};
@@ -13,28 +13,98 @@
 CircularBufferDelayAudioProcessorEditor::CircularBufferDelayAudioProcessorEditor (CircularBufferDelayAudioProcessor& p)
     : AudioProcessorEditor (&p), audioProcessor (p)
 {
+    addKnob (ParameterIDs::delayTime,  "Delay Time");
+    addKnob (ParameterIDs::maxDelay,   "Max Delay");
+    addKnob (ParameterIDs::inputGain,  "Input Gain");
+    addKnob (ParameterIDs::feedback,   "Feedback");
+    addKnob (ParameterIDs::dry,        "Dry");
+    addKnob (ParameterIDs::wet,        "Wet");
+    addKnob (ParameterIDs::modRate,    "Mod Rate");
+    addKnob (ParameterIDs::modDepth,   "Mod Depth");
+    addKnob (ParameterIDs::tapCount,   "Taps");
+    addKnob (ParameterIDs::tapSpacing, "Tap Spacing");
+    addKnob (ParameterIDs::tapDecay,   "Tap Decay");
+    addKnob (ParameterIDs::changeTime, "Change Time");
+
+    addChoiceBox (ParameterIDs::interpolation);
+    addChoiceBox (ParameterIDs::timeChange);
+    addChoiceBox (ParameterIDs::clearEchoes);
+
+    captureButton.onClick = [this]
+    {
+        auto file = juce::File::getSpecialLocation (juce::File::userDocumentsDirectory)
+                        .getNonexistentChildFile ("Delay capture", ".wav");
+
+        audioProcessor.captureDelayHistory (file, audioProcessor.parameters.getRawParameterValue (ParameterIDs::maxDelay)->load() / 1000.0);
+    };
+
+    addAndMakeVisible (captureButton);
+
     // Make sure that before the constructor has finished, you've set the
     // editor's size to whatever you need it to be.
-    setSize (400, 300);
+    setSize (400, 40 + 150 * ((knobs.size() + knobsPerRow - 1) / knobsPerRow));
 }
 
 CircularBufferDelayAudioProcessorEditor::~CircularBufferDelayAudioProcessorEditor()
 {
 }
 
+void CircularBufferDelayAudioProcessorEditor::addKnob (const juce::String& parameterID, const juce::String& labelText)
+{
+    auto* knob = knobs.add (new juce::Slider (juce::Slider::RotaryHorizontalVerticalDrag, juce::Slider::TextBoxBelow));
+    addAndMakeVisible (knob);
+
+    auto* label = knobLabels.add (new juce::Label ({}, labelText));
+    label->setJustificationType (juce::Justification::centred);
+    addAndMakeVisible (label);
+
+    knobAttachments.add (new juce::AudioProcessorValueTreeState::SliderAttachment (audioProcessor.parameters, parameterID, *knob));
+}
+
+void CircularBufferDelayAudioProcessorEditor::addChoiceBox (const juce::String& parameterID)
+{
+    auto* box = choiceBoxes.add (new juce::ComboBox());
+
+    // the items have to be in place before the attachment picks the current one
+    if (auto* choice = dynamic_cast<juce::AudioParameterChoice*> (audioProcessor.parameters.getParameter (parameterID)))
+        box->addItemList (choice->choices, 1);
+
+    addAndMakeVisible (box);
+    choiceBoxAttachments.add (new juce::AudioProcessorValueTreeState::ComboBoxAttachment (audioProcessor.parameters, parameterID, *box));
+}
+
 //==============================================================================
 void CircularBufferDelayAudioProcessorEditor::paint (juce::Graphics& g)
 {
     // (Our component is opaque, so we must completely fill the background with a solid colour)
     g.fillAll (getLookAndFeel().findColour (juce::ResizableWindow::backgroundColourId));
-
-    g.setColour (juce::Colours::white);
-    g.setFont (15.0f);
-    g.drawFittedText ("Hello World!", getLocalBounds(), juce::Justification::centred, 1);
 }
 
 void CircularBufferDelayAudioProcessorEditor::resized()
 {
-    // This is generally where you'll want to lay out the positions of any
-    // subcomponents in your editor..
+    // the choices go side by side along the top with the capture button, then the knobs in rows,
+    // each with its label underneath
+    auto area = getLocalBounds().reduced (10);
+    auto choiceRow = area.removeFromTop (24);
+    captureButton.setBounds (choiceRow.removeFromRight (80).reduced (2, 0));
+    auto choiceWidth = choiceRow.getWidth() / juce::jmax (1, choiceBoxes.size());
+
+    for (auto* box : choiceBoxes)
+        box->setBounds (choiceRow.removeFromLeft (choiceWidth).reduced (2, 0));
+
+    area.removeFromTop (6);
+
+    auto numRows = (knobs.size() + knobsPerRow - 1) / knobsPerRow;
+    auto rowHeight = area.getHeight() / juce::jmax (1, numRows);
+    auto knobWidth = area.getWidth() / knobsPerRow;
+
+    for (int i = 0; i < knobs.size(); ++i)
+    {
+        auto column = juce::Rectangle<int> (area.getX() + (i % knobsPerRow) * knobWidth,
+                                            area.getY() + (i / knobsPerRow) * rowHeight,
+                                            knobWidth, rowHeight);
+
+        knobLabels[i]->setBounds (column.removeFromBottom (20));
+        knobs[i]->setBounds (column.reduced (4));
+    }
 }
@@ -25,9 +25,27 @@ public:
     void resized() override;
 
 private:
+    // adds a rotary slider with a label underneath, attached to one of the processor's parameters
+    void addKnob (const juce::String& parameterID, const juce::String& labelText);
+
+    // adds a drop-down list of the choices of one of the processor's choice parameters
+    void addChoiceBox (const juce::String& parameterID);
+
     // This reference is provided as a quick way for your editor to
     // access the processor object that created it.
     CircularBufferDelayAudioProcessor& audioProcessor;
 
+    static constexpr int knobsPerRow = 4;
+
+    juce::OwnedArray<juce::Slider> knobs;
+    juce::OwnedArray<juce::Label> knobLabels;
+    juce::OwnedArray<juce::AudioProcessorValueTreeState::SliderAttachment> knobAttachments;
+
+    juce::OwnedArray<juce::ComboBox> choiceBoxes;
+    juce::OwnedArray<juce::AudioProcessorValueTreeState::ComboBoxAttachment> choiceBoxAttachments;
+
+    // saves the last Max Delay's worth of input to a WAV file in the user's documents folder
+    juce::TextButton captureButton { "Capture" };
+
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (CircularBufferDelayAudioProcessorEditor)
 };
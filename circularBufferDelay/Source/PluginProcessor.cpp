@@ -8,6 +8,7 @@
 
 #include "PluginProcessor.h"
 #include "PluginEditor.h"
+#include "DelayKernels.h"
 
 //==============================================================================
 CircularBufferDelayAudioProcessor::CircularBufferDelayAudioProcessor()
@@ -19,15 +20,94 @@ CircularBufferDelayAudioProcessor::CircularBufferDelayAudioProcessor()
                       #endif
                        .withOutput ("Output", juce::AudioChannelSet::stereo(), true)
                      #endif
-                       )
+                       ),
+#else
+     :
 #endif
+       parameters (*this, nullptr, "Parameters", createParameterLayout())
 {
+    delayTimeParameter     = parameters.getRawParameterValue (ParameterIDs::delayTime);
+    maxDelayParameter      = parameters.getRawParameterValue (ParameterIDs::maxDelay);
+    inputGainParameter     = parameters.getRawParameterValue (ParameterIDs::inputGain);
+    feedbackParameter      = parameters.getRawParameterValue (ParameterIDs::feedback);
+    dryParameter           = parameters.getRawParameterValue (ParameterIDs::dry);
+    wetParameter           = parameters.getRawParameterValue (ParameterIDs::wet);
+    interpolationParameter = parameters.getRawParameterValue (ParameterIDs::interpolation);
+    modRateParameter       = parameters.getRawParameterValue (ParameterIDs::modRate);
+    modDepthParameter      = parameters.getRawParameterValue (ParameterIDs::modDepth);
+    tapCountParameter      = parameters.getRawParameterValue (ParameterIDs::tapCount);
+    tapSpacingParameter    = parameters.getRawParameterValue (ParameterIDs::tapSpacing);
+    tapDecayParameter      = parameters.getRawParameterValue (ParameterIDs::tapDecay);
+    timeChangeParameter    = parameters.getRawParameterValue (ParameterIDs::timeChange);
+    changeTimeParameter    = parameters.getRawParameterValue (ParameterIDs::changeTime);
+    clearEchoesParameter   = parameters.getRawParameterValue (ParameterIDs::clearEchoes);
+
+    // (a compressed delay buffer is already long enough for any Max Delay, so there's nothing to watch)
+   #if ! CIRCULARBUFFERDELAY_COMPRESSED_HISTORY
+    startTimerHz (10);
+   #endif
 }
 
 CircularBufferDelayAudioProcessor::~CircularBufferDelayAudioProcessor()
 {
 }
 
+juce::AudioProcessorValueTreeState::ParameterLayout CircularBufferDelayAudioProcessor::createParameterLayout()
+{
+    juce::AudioProcessorValueTreeState::ParameterLayout layout;
+
+    layout.add (std::make_unique<juce::AudioParameterFloat> (ParameterIDs::delayTime, "Delay Time",
+                                                             juce::NormalisableRange<float> (1.0f, 2000.0f, 0.1f, 0.4f), 500.0f, "ms"));
+
+    // the delay buffer is only as big as this needs, so a short slapback doesn't hold on to seconds of memory
+    layout.add (std::make_unique<juce::AudioParameterFloat> (ParameterIDs::maxDelay, "Max Delay",
+                                                             juce::NormalisableRange<float> (10.0f, 2000.0f, 0.1f, 0.4f), 2000.0f, "ms"));
+
+    // how loud the input goes into the delay buffer, and so how loud the echoes come back; by default
+    // the -20 dB it always was
+    layout.add (std::make_unique<juce::AudioParameterFloat> (ParameterIDs::inputGain, "Input Gain",
+                                                             juce::NormalisableRange<float> (0.0f, 1.0f), 0.1f));
+    layout.add (std::make_unique<juce::AudioParameterFloat> (ParameterIDs::feedback, "Feedback",
+                                                             juce::NormalisableRange<float> (0.0f, 0.95f), 0.4f));
+    layout.add (std::make_unique<juce::AudioParameterFloat> (ParameterIDs::dry, "Dry",
+                                                             juce::NormalisableRange<float> (0.0f, 1.0f), 1.0f));
+    layout.add (std::make_unique<juce::AudioParameterFloat> (ParameterIDs::wet, "Wet",
+                                                             juce::NormalisableRange<float> (0.0f, 1.0f), 0.5f));
+
+    // a depth of 0 switches the modulation off
+    layout.add (std::make_unique<juce::AudioParameterFloat> (ParameterIDs::modRate, "Mod Rate",
+                                                             juce::NormalisableRange<float> (0.01f, 10.0f, 0.0f, 0.4f), 0.5f, "Hz"));
+    layout.add (std::make_unique<juce::AudioParameterFloat> (ParameterIDs::modDepth, "Mod Depth",
+                                                             juce::NormalisableRange<float> (0.0f, 20.0f, 0.0f, 0.5f), 0.0f, "ms"));
+
+    // a tap count of 0 switches the extra taps off
+    layout.add (std::make_unique<juce::AudioParameterInt> (ParameterIDs::tapCount, "Taps", 0, 32, 0));
+    layout.add (std::make_unique<juce::AudioParameterFloat> (ParameterIDs::tapSpacing, "Tap Spacing",
+                                                             juce::NormalisableRange<float> (10.0f, 1000.0f, 0.1f, 0.5f), 125.0f, "ms"));
+    layout.add (std::make_unique<juce::AudioParameterFloat> (ParameterIDs::tapDecay, "Tap Decay",
+                                                             juce::NormalisableRange<float> (0.0f, 1.0f), 0.7f));
+
+    // what the read head does when the delay time moves, in the same order as the DelayTimeChange enum
+    layout.add (std::make_unique<juce::AudioParameterChoice> (ParameterIDs::timeChange, "Time Change",
+                                                              juce::StringArray { "Jump", "Crossfade", "Tape" },
+                                                              (int) DelayTimeChange::crossfade));
+    layout.add (std::make_unique<juce::AudioParameterFloat> (ParameterIDs::changeTime, "Change Time",
+                                                             juce::NormalisableRange<float> (1.0f, 1000.0f, 0.1f, 0.4f), 100.0f, "ms"));
+
+    // in the same order as the EchoClearing enum; by default the echoes ring on through a stop, as they always have
+    layout.add (std::make_unique<juce::AudioParameterChoice> (ParameterIDs::clearEchoes, "Clear Echoes",
+                                                              juce::StringArray { "Never", "On Stop", "On Stop Or Jump" },
+                                                              (int) EchoClearing::never));
+
+    // in the same order as the DelayInterpolation enum
+    layout.add (std::make_unique<juce::AudioParameterChoice> (ParameterIDs::interpolation, "Interpolation",
+                                                              juce::StringArray { "None", "Linear", "Lagrange (3rd order)", "Lagrange (5th order)",
+                                                                                  "Thiran Allpass", "Windowed Sinc" },
+                                                              (int) DelayInterpolation::linear));
+
+    return layout;
+}
+
 //==============================================================================
 const juce::String CircularBufferDelayAudioProcessor::getName() const
 {
@@ -63,7 +143,18 @@ bool CircularBufferDelayAudioProcessor::isMidiEffect() const
 
 double CircularBufferDelayAudioProcessor::getTailLengthSeconds() const
 {
-    return 0.0;
+    // how long the echoes of a full-scale input take to die away below the level processBlock goes to sleep at,
+    // going round at the delay time (plus however far the modulation reaches past it), as heard through Wet;
+    // the taps read that same decaying buffer through Wet too, so unless there's nothing to hear at all,
+    // the longest of them adds its own delay on top
+    auto delayMs = juce::jmin (delayTimeParameter->load(), maxDelayParameter->load()) + modDepthParameter->load();
+    auto tailSeconds = DelayTailTracker<DelaySample>::getTailLengthSeconds (delayMs / 1000.0, feedbackParameter->load(),
+                                                                            inputGainParameter->load(), wetParameter->load());
+
+    if (tailSeconds > 0.0 && juce::roundToInt (tapCountParameter->load()) > 0)
+        tailSeconds += juce::jmin (juce::roundToInt (tapCountParameter->load()) * tapSpacingParameter->load(), maxDelayParameter->load()) / 1000.0;
+
+    return tailSeconds;
 }
 
 int CircularBufferDelayAudioProcessor::getNumPrograms()
@@ -102,14 +193,135 @@ void CircularBufferDelayAudioProcessor::changeProgramName (int index, const juce
 void CircularBufferDelayAudioProcessor::prepareToPlay (double sampleRate, int samplesPerBlock)
 {
     // here is where we actually set the size of our delay buffer
-    // 44,100 * 2 = 88,200 which will be our circular buffer size
-    auto delayBufferSize = sampleRate * 2.0;
-    
-    // call method we created in header file delayBuffer.setSize
+    // for the default max delay of 2 seconds that's a bit over 44,100 * 2 = 88,200, which the delay line
+    // rounds up to the next power of two (131,072) so that it can wrap its positions with a bitmask instead of a modulo
+    auto delayBufferSize = getDelayBufferSize (sampleRate, samplesPerBlock);
+
     // getTotalNumOutputChannels (probably 2, a stereo signal)
-    // set number of samples we want our buffer to have for its size (use delayBufferSize)
-    // cast delayBufferSize to int with (int) before delayBufferSize
-    delayBuffer.setSize(getTotalNumOutputChannels(), (int)delayBufferSize);
+    auto numDelayChannels = juce::jmin (getTotalNumOutputChannels(), maxDelayChannels);
+
+    // the host restarting the transport calls this again with the same settings:
+    // then there's nothing to do, and the echoes that are still ringing carry on
+    if (sampleRate == preparedSampleRate && samplesPerBlock == preparedBlockSize
+         && numDelayChannels == delayLine.getNumChannels())
+        return;
+
+   #if CIRCULARBUFFERDELAY_COMPRESSED_HISTORY
+    // a compressed buffer can't be rebuilt in the background, so it's built here, long enough for the longest
+    // Max Delay (see getDelayBufferSize), and the echoes start again from silence
+    delayLine.prepare (numDelayChannels, delayBufferSize, juce::jmax (1, samplesPerBlock));
+   #else
+    // a capture that's still reading the old buffer gets cut short rather than pulled out from under
+    delayLineCapture.stopCapture();
+
+    if (delayLine.getNumChannels() == 0)
+    {
+        // ask for mirrored memory so the write position never has to wrap mid-copy
+        // (the delay line quietly falls back to a plain buffer where that isn't possible,
+        // with enough guard samples past the end for the longest interpolator to read over the seam),
+        // or for a slab of the process-wide arena if the build has opted into that
+       #if CIRCULARBUFFERDELAY_USE_SHARED_ARENA
+        auto backing = decltype (delayLine)::Backing::pooled;
+       #else
+        auto backing = decltype (delayLine)::Backing::mirrored;
+       #endif
+
+        // every page of it gets touched here, rather than by the first few blocks of audio
+        DelayMemoryOptions memoryOptions;
+        memoryOptions.prefault     = true;
+        memoryOptions.lockInMemory = CIRCULARBUFFERDELAY_LOCK_DELAY_MEMORY != 0;
+        memoryOptions.useHugePages = CIRCULARBUFFERDELAY_USE_HUGE_PAGES != 0;
+        delayLine.setMemoryOptions (memoryOptions);
+
+        delayLine.prepare (numDelayChannels, delayBufferSize, backing, DelayInterpolationKernels::maxTaps - 1);
+    }
+    else if (juce::nextPowerOfTwo (delayBufferSize) != juce::nextPowerOfTwo (requestedBufferSize)
+              || numDelayChannels != delayLine.getNumChannels())
+    {
+        // after the first time, a new size is built in the background with the history copied across,
+        // and processBlock swaps it in (until then, delay times are clamped to the old size)
+        delayLineResizer.requestResize (numDelayChannels, delayBufferSize, samplesPerBlock);
+    }
+   #endif
+
+    requestedBufferSize = delayBufferSize;
+
+   #if CIRCULARBUFFERDELAY_CLEAR_IN_BACKGROUND && ! CIRCULARBUFFERDELAY_COMPRESSED_HISTORY
+    // the resizer's thread is the one allowed to touch the buffer's memory, so it does the zeroing too
+    delayLineResizer.setClearsInBackground (true, samplesPerBlock);
+   #endif
+
+    preparedSampleRate = sampleRate;
+    preparedBlockSize = samplesPerBlock;
+
+    tailTracker.reset();
+    delayReader.reset();
+    delayedSamples.assign ((size_t) juce::jmax (1, samplesPerBlock), 0.0f);
+    delayTimes.assign (delayedSamples.size(), 0.0f);
+    transition.prepare (sampleRate);
+    incomingReader.reset();
+    incomingSamples.assign (delayedSamples.size(), 0.0f);
+   #if CIRCULARBUFFERDELAY_COMPRESSED_HISTORY
+    samplesToCompress.assign (delayedSamples.size(), 0.0f);
+   #endif
+    modulator.prepare (sampleRate);
+    multiTap.prepare (sampleRate, numDelayChannels);
+    smoothedInputGain.reset (sampleRate, inputGainRampSeconds);
+    smoothedInputGain.setCurrentAndTargetValue (inputGainParameter->load());
+}
+
+int CircularBufferDelayAudioProcessor::getDelayBufferSize (double sampleRate, int samplesPerBlock) const
+{
+    // the longest delay allowed, the modulation swinging past it, the interpolator's taps,
+    // and a block that's been written but not read yet (a compressed buffer is never resized,
+    // so it's made long enough for the longest the max delay setting goes up to)
+   #if CIRCULARBUFFERDELAY_COMPRESSED_HISTORY
+    auto maxDelayMs = parameters.getParameterRange (ParameterIDs::maxDelay).end;
+   #else
+    auto maxDelayMs = maxDelayParameter->load();
+   #endif
+
+    auto longestDelayMs = maxDelayMs + parameters.getParameterRange (ParameterIDs::modDepth).end;
+
+    return (int) std::ceil (longestDelayMs * sampleRate / 1000.0) + DelayInterpolationKernels::maxTaps + samplesPerBlock;
+}
+
+void CircularBufferDelayAudioProcessor::timerCallback()
+{
+   #if ! CIRCULARBUFFERDELAY_COMPRESSED_HISTORY
+    // a capture reads the buffer as it is, so a new size has to wait until it's done
+    if (preparedSampleRate <= 0.0 || delayLineCapture.isCapturing())
+        return;
+
+    // the line rounds up to a power of two anyway, so only a change that crosses one is worth a rebuild;
+    // growing keeps the history and the read heads where they are, so it's seamless
+    auto delayBufferSize = getDelayBufferSize (preparedSampleRate, preparedBlockSize);
+
+    if (juce::nextPowerOfTwo (delayBufferSize) != juce::nextPowerOfTwo (requestedBufferSize))
+    {
+        delayLineResizer.requestResize (juce::jmin (getTotalNumOutputChannels(), maxDelayChannels), delayBufferSize, preparedBlockSize);
+        requestedBufferSize = delayBufferSize;
+    }
+   #endif
+}
+
+bool CircularBufferDelayAudioProcessor::captureDelayHistory (const juce::File& destination, double seconds)
+{
+   #if CIRCULARBUFFERDELAY_COMPRESSED_HISTORY
+    juce::ignoreUnused (destination, seconds);
+    return false;
+   #else
+    if (preparedSampleRate <= 0.0 || delayLineResizer.isResizing() || delayLine.getNumSamplesWritten() == 0)
+        return false;
+
+    // the delay buffer holds the input at the input gain (plus whatever is feeding back), so scale it
+    // back up to where it came in, as best we can: at the gain it's set to now, but never by more than
+    // it would take to undo the default -20 dB, or a gain near 0 would blow the feedback up to full scale
+    auto inputGain = juce::jmax (inputGainParameter->load(), minimumCaptureInputGain);
+
+    return delayLineCapture.startCapture (destination, juce::roundToInt (seconds * preparedSampleRate),
+                                          preparedSampleRate, preparedBlockSize, (DelaySample) (1.0f / inputGain));
+   #endif
 }
 
 void CircularBufferDelayAudioProcessor::releaseResources()
@@ -150,6 +362,31 @@ bool CircularBufferDelayAudioProcessor::isBusesLayoutSupported (const BusesLayou
 void CircularBufferDelayAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
 {
     juce::ScopedNoDenormals noDenormals;
+    processDelay (buffer);
+}
+
+// hosts with a 64-bit mix engine hand us doubles, which go through the same code; the delay buffer keeps
+// whatever precision it was built with (see CIRCULARBUFFERDELAY_DOUBLE_PRECISION_HISTORY), and each sample
+// is converted on its way in or out of it by the same loop that writes or reads it
+void CircularBufferDelayAudioProcessor::processBlock (juce::AudioBuffer<double>& buffer, juce::MidiBuffer& midiMessages)
+{
+    juce::ScopedNoDenormals noDenormals;
+    processDelay (buffer);
+}
+
+template <typename SampleType>
+void CircularBufferDelayAudioProcessor::processDelay (juce::AudioBuffer<SampleType>& buffer)
+{
+
+   #if ! CIRCULARBUFFERDELAY_COMPRESSED_HISTORY
+    // if the delay buffer has been rebuilt at a new size in the background, start using it
+    delayLineResizer.swapIfReady();
+
+    // a capture's history is copied out of the delay buffer here, a slice per block, as this is the
+    // thread that writes it
+    delayLineCapture.copyHistory();
+   #endif
+
     auto totalNumInputChannels  = getTotalNumInputChannels();
     auto totalNumOutputChannels = getTotalNumOutputChannels();
 
@@ -157,52 +394,465 @@ void CircularBufferDelayAudioProcessor::processBlock (juce::AudioBuffer<float>&
     for (auto i = totalNumInputChannels; i < totalNumOutputChannels; ++i)
         buffer.clear (i, 0, buffer.getNumSamples());
 
+    // a stop or a jump in the host's transport can drop the echoes from before it
+    clearEchoesOnTransportChange (buffer.getNumSamples());
+
+    // STEP 10
+    // an idle delay does no work at all: once its input and all of its echoes have died away, its blocks are
+    // skipped (the input is below -100 dB, so it may as well pass through as it is) until something comes in again
+    // (the input is only scanned while asleep, or once what goes into the line has gone quiet)
+    auto inputChecked = tailTracker.needsInputCheck();
+    auto inputHasSignal = inputChecked && tailTracker.hasSignal (buffer, totalNumInputChannels, buffer.getNumSamples());
+
+    if (tailTracker.isAsleep())
+    {
+        if (! inputHasSignal)
+            return;
+
+        // the history is all silence by now, so nothing needs to glide or crossfade (or ramp) from where it was
+        tailTracker.wakeUp();
+        transition.reset();
+        delayReader.reset();
+        incomingReader.reset();
+        multiTap.reset();
+        smoothedInputGain.setCurrentAndTargetValue (inputGainParameter->load());
+    }
+
     // step 6
+    auto numDelayChannels = juce::jmin (totalNumInputChannels, delayLine.getNumChannels());
+
+    // STEP 8
+    // the read position sits delayInSamples behind the write position, which needn't be a whole number
+    auto interpolation = static_cast<DelayInterpolation> (juce::roundToInt (interpolationParameter->load()));
+    auto interpolationChanged = interpolation != delayReader.getInterpolation();
+    delayReader.setInterpolation (interpolation);
+    incomingReader.setInterpolation (interpolation);
+
+    // with modulation switched on the read position also swings depthInSamples either side of that
+    // (but no further than the buffer has room for both ways: after the sample rate goes up, the buffer
+    // stays at the old size until the resizer swaps the new one in, and a short Max Delay can leave it
+    // too small for the whole swing at the new rate for a moment)
+    auto longestBufferDelay = (double) (delayLine.getMaximumDelay() - DelayInterpolationKernels::maxTaps);
+    auto depthInSamples = juce::jlimit (0.0, juce::jmax (0.0, (longestBufferDelay - delayReader.getMinimumDelay()) / 2.0),
+                                        modDepthParameter->load() * getSampleRate() / 1000.0);
+    modulator.setRate (modRateParameter->load());
+
+    // (never longer than the max delay setting, nor than the buffer, which can lag behind that setting for a moment)
+    auto delayInSamples = juce::jlimit (delayReader.getMinimumDelay() + depthInSamples,
+                                        longestBufferDelay - depthInSamples,
+                                        juce::jmin (delayTimeParameter->load(), maxDelayParameter->load()) * getSampleRate() / 1000.0);
+
+    // when the delay time changes, the read position doesn't jump there but crossfades or glides
+    // (if the heads that are still moving have ended up out of range, e.g. because the modulation
+    // depth went up, or the interpolator has changed under them, there's nothing to do but jump)
+    transition.setMode (static_cast<DelayTimeChange> (juce::roundToInt (timeChangeParameter->load())));
+    transition.setTransitionTime (changeTimeParameter->load() / 1000.0);
+
+    if (interpolationChanged
+        || transition.getShortestDelay() - depthInSamples < delayReader.getMinimumDelay()
+        || transition.getLongestDelay() + depthInSamples > longestBufferDelay)
+        transition.reset();
+
+    transition.setTargetDelay (delayInSamples);
+    smoothedInputGain.setTargetValue (inputGainParameter->load());
+
+   #if CIRCULARBUFFERDELAY_COMPRESSED_HISTORY
+    processInterpolatedDelay (buffer, numDelayChannels, depthInSamples);
+   #else
+    if (delayReader.getInterpolation() == DelayInterpolation::none && depthInSamples <= 0.0 && ! transition.isActive())
+        processWholeSampleDelay (buffer, numDelayChannels, juce::roundToInt (transition.getCurrentDelay()));
+    else
+        processInterpolatedDelay (buffer, numDelayChannels, depthInSamples);
+
+    // STEP 9
+    // the extra taps read the same delay buffer, now that the whole block has been written into it
+    updateTaps();
+
+    if (multiTap.isActive())
+    {
+        auto bufferSize = buffer.getNumSamples();
+        auto blockStart = (delayLine.getWritePosition() - bufferSize) & (delayLine.getCapacity() - 1);
+
+        for (int channel = 0; channel < numDelayChannels; ++channel)
+            addTaps (buffer.getWritePointer (channel), channel, bufferSize, blockStart, wetParameter->load());
+
+        multiTap.advance (bufferSize);
+    }
+   #endif
+
+    // with nothing coming in, go to sleep once everything that's gone into the delay buffer has been quiet
+    // for as far back as anything reads it (the main read head, wherever the modulation takes it, and the taps,
+    // which read back from the start of the block); the lazy clear makes sure that a longer delay time
+    // set while asleep can't reach back past that to older echoes
     auto bufferSize = buffer.getNumSamples();
-    auto delayBufferSize = delayBuffer.getNumSamples();
-    
-    for (int channel = 0; channel < totalNumInputChannels; ++channel)
+    auto longestRead = juce::jmax ((int) std::ceil (transition.getLongestDelay() + depthInSamples) + DelayInterpolationKernels::maxTaps,
+                                   multiTap.isActive() ? multiTap.getLongestDelay() + bufferSize : 0);
+
+   #if CIRCULARBUFFERDELAY_COMPRESSED_HISTORY
+    auto writeWasQuiet = delayLine.isQuiet (bufferSize, tailTracker.getThreshold());
+   #else
+    auto writeWasQuiet = tailTracker.wasWriteQuiet (delayLine, bufferSize);
+   #endif
+
+    if (tailTracker.blockWasProcessed (inputChecked && ! inputHasSignal, writeWasQuiet, bufferSize, longestRead))
+    {
+        tailTracker.goToSleep();
+        clearEchoes();
+    }
+}
+
+void CircularBufferDelayAudioProcessor::clearEchoes()
+{
+   #if CIRCULARBUFFERDELAY_COMPRESSED_HISTORY
+    // a compressed buffer only has to mark its blocks as silent, a byte each
+    delayLine.clear();
+   #else
+    // rather than zeroing seconds of buffer in one block, this marks it all as silent, and zeroes just enough
+    // before the write position for the recursive whole-sample kernel (which doesn't check) and any interpolator
+    // that straddles it; the readers skip the rest until it's overwritten, or the resizer's thread zeroes it
+    delayLine.clearLazily (juce::jmax (DelayKernels::minimumDelayForStretches, DelayInterpolationKernels::maxTaps));
+   #endif
+}
+
+void CircularBufferDelayAudioProcessor::clearEchoesOnTransportChange (int numSamples)
+{
+    auto* playHead = getPlayHead();
+
+    if (playHead == nullptr)
+        return;
+
+   #if JUCE_MAJOR_VERSION >= 7
+    // (a host that doesn't say where it is can't be caught jumping, so it's taken to be where it should be)
+    auto position = playHead->getPosition();
+
+    if (! position.hasValue())
+        return;
+
+    auto isPlaying = position->getIsPlaying();
+    auto timeInSamples = position->getTimeInSamples().orFallback (expectedTransportPosition);
+   #else
+    juce::AudioPlayHead::CurrentPositionInfo position;
+
+    if (! playHead->getCurrentPosition (position))
+        return;
+
+    auto isPlaying = position.isPlaying;
+    auto timeInSamples = position.timeInSamples;
+   #endif
+
+    auto stopped = transportWasPlaying && ! isPlaying;
+    auto jumped  = transportWasPlaying && isPlaying && timeInSamples != expectedTransportPosition;
+
+    transportWasPlaying = isPlaying;
+    expectedTransportPosition = timeInSamples + numSamples;
+
+    auto clearing = static_cast<EchoClearing> (juce::roundToInt (clearEchoesParameter->load()));
+
+    if ((stopped && clearing != EchoClearing::never) || (jumped && clearing == EchoClearing::onStopOrJump))
+        clearEchoes();
+}
+
+#if ! CIRCULARBUFFERDELAY_COMPRESSED_HISTORY
+void CircularBufferDelayAudioProcessor::addTaps (DelaySample* output, int channel, int numSamples, int blockStart, float gain)
+{
+    multiTap.process (delayLine, channel, output, numSamples, blockStart, (DelaySample) gain);
+}
+
+template <typename SampleType>
+void CircularBufferDelayAudioProcessor::addTaps (SampleType* output, int channel, int numSamples, int blockStart, float gain)
+{
+    // the taps only know how to add into the delay buffer's own precision, so they go via delayedSamples
+    // (free again by now), a stretch at a time in case the host's block is longer than it said it would be
+    auto maxStretch = (int) delayedSamples.size();
+
+    for (int start = 0; start < numSamples; start += maxStretch)
+    {
+        auto stretch = juce::jmin (maxStretch, numSamples - start);
+
+        juce::FloatVectorOperations::clear (delayedSamples.data(), stretch);
+        multiTap.process (delayLine, channel, delayedSamples.data(), stretch,
+                          (blockStart + start) & (delayLine.getCapacity() - 1), (DelaySample) gain, start);
+
+        for (int i = 0; i < stretch; ++i)
+            output[start + i] += (SampleType) delayedSamples[(size_t) i];
+    }
+}
+#endif
+
+void CircularBufferDelayAudioProcessor::updateTaps()
+{
+    // an evenly spaced pattern: each tap quieter and darker than the one before,
+    // alternating left and right
+    std::array<decltype (multiTap)::Tap, decltype (multiTap)::maxTaps> taps;
+
+    auto numTaps = juce::jlimit (0, (int) taps.size(), juce::roundToInt (tapCountParameter->load()));
+    auto spacing = tapSpacingParameter->load() * getSampleRate() / 1000.0;
+    auto decay   = tapDecayParameter->load();
+
+    // a tap mustn't reach past the max delay setting, or back into the part of the buffer
+    // this block has just overwritten
+    auto longestTap = juce::jmin (delayLine.getMaximumDelay() - (int) delayedSamples.size(),
+                                  juce::roundToInt (maxDelayParameter->load() * getSampleRate() / 1000.0));
+    auto gain = 1.0f;
+
+    for (int k = 0; k < numTaps; ++k)
+    {
+        gain *= decay;
+
+        auto& tap = taps[(size_t) k];
+        tap.delayInSamples = juce::jlimit (1, longestTap, juce::roundToInt ((k + 1) * spacing));
+        tap.gain = gain;
+        tap.pan = (k % 2 == 0) ? -0.7f : 0.7f;
+        tap.cutoffHz = juce::jmax (500.0f, 16000.0f * std::pow (0.8f, (float) k));
+    }
+
+    multiTap.setTaps (taps.data(), numTaps);
+}
+
+template <typename SampleType>
+SampleType CircularBufferDelayAudioProcessor::advanceInputGain (int numSamples, SampleType& gainStep)
+{
+    auto startGain = (SampleType) smoothedInputGain.getCurrentValue();
+
+    // a ramp that ends part way through the stretch is spread over all of it, which is near enough
+    gainStep = smoothedInputGain.isSmoothing() ? ((SampleType) smoothedInputGain.skip (numSamples) - startGain) / (SampleType) numSamples
+                                               : SampleType();
+    return startGain;
+}
+
+#if ! CIRCULARBUFFERDELAY_COMPRESSED_HISTORY
+template <typename SampleType>
+void CircularBufferDelayAudioProcessor::processWholeSampleDelay (juce::AudioBuffer<SampleType>& buffer, int numChannels, int delaySamples)
+{
+    auto bufferSize = buffer.getNumSamples();
+    auto feedback  = (SampleType) feedbackParameter->load();
+    auto dry       = (SampleType) dryParameter->load();
+    auto wet       = (SampleType) wetParameter->load();
+
+    // a delay this short would mean stretches too small to be worth vectorising,
+    // so the feedback goes round one sample at a time instead
+    if (delaySamples < DelayKernels::minimumDelayForStretches)
     {
-        auto* channelData = buffer.getWritePointer (channel);
-
-        // Check to see if main buffer copies to delay buffer without need to wrap...
-        if (delayBufferSize > bufferSize + writePosition) {
-            // if yes
-                // copy main buffer contents to delay buffer
-            // (this is just if we're able to copy the buffer size amount of samples without going over the end of our circular buffer)
-            delayBuffer.copyFromWithRamp(channel, writePosition, channelData, bufferSize, 0.1f, 0.1f);
+        auto gainStep = SampleType();
+        auto inputGain = advanceInputGain (bufferSize, gainStep);
+
+        for (int channel = 0; channel < numChannels; ++channel)
+            DelayKernels::writeReadFeedbackMixRecursive (buffer.getWritePointer (channel), delayLine.getChannelPointer (channel),
+                                                         delayLine.getCapacity() - 1, delayLine.getWritePosition(), delaySamples,
+                                                         bufferSize, inputGain, feedback, dry, wet, gainStep);
+
+        delayLine.advance (bufferSize);
+        return;
+    }
+
+    // a delay so long that what's written is out of cache by the time it's read back streams its
+    // writes past the cache instead of evicting everything else on the way (see DelayKernels::shouldStream)
+    auto streaming = DelayKernels::shouldStream (delaySamples, numChannels, sizeof (DelaySample));
+
+    // with feedback, a stretch can't be longer than the delay, or it would read samples it hasn't
+    // written yet: a delay shorter than the host block is done in stretches of exactly the delay
+    for (int start = 0; start < bufferSize;)
+    {
+        auto numSamples = juce::jmin (delaySamples, bufferSize - start);
+
+        // after the buffer's been cleared lazily, what's left of the old history is silence, so
+        // it isn't read at all, in a stretch of its own (the same for every channel)
+        auto numStale = delayLine.getNumStaleSamples (numSamples, delaySamples);
+
+        if (numStale > 0)
+            numSamples = numStale;
+
+        auto gainStep = SampleType();
+        auto inputGain = advanceInputGain (numSamples, gainStep);
+
+        if (numStale > 0)
+        {
+
+            for (int channel = 0; channel < numChannels; ++channel)
+            {
+                auto* channelData = buffer.getWritePointer (channel, start);
+
+                delayLine.getWriteRegion (channel, numSamples).forEachSegment ([&] (SampleSpan<DelaySample> toDelay, int offset)
+                {
+                    DelayKernels::writeMixSilent (channelData + offset, toDelay.data, toDelay.size,
+                                                  inputGain + gainStep * (SampleType) offset, dry, gainStep);
+                });
+            }
+
+            delayLine.advance (numSamples);
+            start += numSamples;
+            continue;
         }
-        // if no
-        else {
-            // Determine how much space is left at the end of the delay buffer
-            auto numSamplesToEnd = delayBufferSize - writePosition;
-            
-            // Copy that amount of contents to the end...
-            delayBuffer.copyFromWithRamp(channel, writePosition, channelData, numSamplesToEnd, 0.1f, 0.1f);
-            
-            // Calculate how much contents is remaining to copy
-            // calculate how many samples we need at the beginning
-            auto numSamplesAtStart = bufferSize - numSamplesToEnd;
-            
-            // Copy remaining amount to beginning of delay buffer
-            delayBuffer.copyFromWithRamp(channel, 0, channelData - numSamplesToEnd, numSamplesAtStart, 0.1f, 0.1f);
+
+        for (int channel = 0; channel < numChannels; ++channel)
+        {
+            auto* channelData = buffer.getWritePointer (channel, start);
+
+            // walk the spot we're writing to and the spot we're reading from together
+            // (with mirrored memory both are always one contiguous run; otherwise the delay line
+            // hands them to us in up to three pieces where one of them wraps around)
+            // and do the write, the read and the feedback in a single pass over each piece
+            forEachCommonSegment (delayLine.getWriteRegion (channel, numSamples),
+                                  delayLine.getReadRegion (channel, numSamples, delaySamples),
+                                  [&] (SampleSpan<DelaySample> toDelay, SampleSpan<const DelaySample> fromDelay, int offset)
+                                  {
+                                      // (the input gain only needs a ramp for the few blocks it takes to change)
+                                      if (gainStep != SampleType())
+                                          DelayKernels::writeReadFeedbackMixRamp (channelData + offset, toDelay.data, fromDelay.data, toDelay.size,
+                                                                                  inputGain + gainStep * (SampleType) offset, gainStep,
+                                                                                  feedback, dry, wet);
+                                      else if (streaming)
+                                          DelayKernels::writeReadFeedbackMixStreaming (channelData + offset, toDelay.data, fromDelay.data, toDelay.size,
+                                                                                       inputGain, feedback, dry, wet);
+                                      else
+                                          DelayKernels::writeReadFeedbackMix (channelData + offset, toDelay.data, fromDelay.data, toDelay.size,
+                                                                              inputGain, feedback, dry, wet);
+                                  });
+        }
+
+        // step 5 / STEP 7
+        // move the write position on by the stretch so the next one (or the next callback)
+        // copies to where this one stopped; the delay line keeps it between 0 and its size
+        delayLine.advance (numSamples);
+        start += numSamples;
+    }
+}
+
+#endif
+
+// the interpolated path's read heads read the delay buffer through these, whichever way it keeps its history
+template <typename Reader, typename SampleType, int NumChannels>
+static void readDelayLine (Reader& reader, const CircularDelayLine<SampleType, NumChannels>& line, int channel,
+                           SampleType* dest, int numSamples, double delayInSamples)
+{
+    reader.read (line, channel, dest, numSamples, delayInSamples);
+}
+
+template <typename Reader, DelaySampleFormat Format, int NumChannels>
+static void readDelayLine (Reader& reader, CompressedDelayLine<Format, NumChannels>& line, int channel,
+                           float* dest, int numSamples, double delayInSamples)
+{
+    line.readInterpolated (reader, channel, dest, numSamples, delayInSamples);
+}
+
+template <typename Reader, typename SampleType, int NumChannels>
+static void readDelayLineModulated (Reader& reader, const CircularDelayLine<SampleType, NumChannels>& line, int channel,
+                                    SampleType* dest, int numSamples, const SampleType* delays)
+{
+    reader.readModulated (line, channel, dest, numSamples, delays);
+}
+
+template <typename Reader, DelaySampleFormat Format, int NumChannels>
+static void readDelayLineModulated (Reader& reader, CompressedDelayLine<Format, NumChannels>& line, int channel,
+                                    float* dest, int numSamples, const float* delays)
+{
+    line.readModulated (reader, channel, dest, numSamples, delays);
+}
+
+template <typename SampleType>
+void CircularBufferDelayAudioProcessor::processInterpolatedDelay (juce::AudioBuffer<SampleType>& buffer, int numChannels, double depthInSamples)
+{
+    auto bufferSize = buffer.getNumSamples();
+    auto feedback  = (SampleType) feedbackParameter->load();
+    auto dry       = (SampleType) dryParameter->load();
+    auto wet       = (SampleType) wetParameter->load();
+
+    // here the whole stretch is read before any of it is written, so a stretch can't be longer
+    // than the delay of the newest sample the interpolator looks at, or it would read samples
+    // from this block that haven't been written yet (with modulation, the shortest delay the LFO reaches,
+    // and during a delay time change, the shortest delay either read head reaches)
+    auto modulated = depthInSamples > 0.0;
+    auto maxStretch = juce::jmax (1, juce::jmin (delayReader.getNewestTapDelay (transition.getShortestDelay() - depthInSamples),
+                                                 (int) delayedSamples.size()));
+
+    // (the same test as for a whole-sample delay, against the soonest anything written gets read back,
+    // but never into samplesToCompress, which is read straight back to be encoded)
+    auto streaming = CIRCULARBUFFERDELAY_COMPRESSED_HISTORY == 0
+                      && DelayKernels::shouldStream (juce::jmax (0, juce::roundToInt (transition.getShortestDelay() - depthInSamples)),
+                                                     numChannels, sizeof (DelaySample));
+
+    for (int start = 0; start < bufferSize;)
+    {
+        // a stretch never straddles the start or end of a delay time change
+        auto numSamples = transition.getStretchLength (juce::jmin (maxStretch, bufferSize - start));
+        auto delayInSamples = transition.getCurrentDelay();
+
+        auto gainStep = SampleType();
+        auto inputGain = advanceInputGain (numSamples, gainStep);
+
+        for (int channel = 0; channel < numChannels; ++channel)
+        {
+            auto* channelData = buffer.getWritePointer (channel, start);
+
+            if (transition.isGliding())
+            {
+                // tape mode: the read head slides, so it gets a delay per sample like the LFO
+                if (modulated)
+                    modulator.fill (channel, delayTimes.data(), numSamples, DelaySample(), (DelaySample) depthInSamples);
+                else
+                    juce::FloatVectorOperations::clear (delayTimes.data(), numSamples);
+
+                transition.addGlide (delayTimes.data(), numSamples);
+                readDelayLineModulated (delayReader, delayLine, channel, delayedSamples.data(), numSamples, delayTimes.data());
+            }
+            else if (modulated)
+            {
+                // one delay time per sample from the LFO, read with gathers
+                modulator.fill (channel, delayTimes.data(), numSamples, (DelaySample) delayInSamples, (DelaySample) depthInSamples);
+                readDelayLineModulated (delayReader, delayLine, channel, delayedSamples.data(), numSamples, delayTimes.data());
+
+                if (transition.isCrossfading())
+                {
+                    // the incoming head follows the same LFO from its own delay
+                    juce::FloatVectorOperations::add (delayTimes.data(), (DelaySample) (transition.getIncomingDelay() - delayInSamples), numSamples);
+                    readDelayLineModulated (incomingReader, delayLine, channel, incomingSamples.data(), numSamples, delayTimes.data());
+                }
+            }
+            else
+            {
+                readDelayLine (delayReader, delayLine, channel, delayedSamples.data(), numSamples, delayInSamples);
+
+                if (transition.isCrossfading())
+                    readDelayLine (incomingReader, delayLine, channel, incomingSamples.data(), numSamples, transition.getIncomingDelay());
+            }
+
+            if (transition.isCrossfading())
+                transition.applyCrossfade (delayedSamples.data(), incomingSamples.data(), numSamples);
+
+            // delayedSamples is only a block long and stays in cache, so the delay memory itself
+            // is still read once and written once, and the write and the mix share a pass
+            auto writeAndMix = [&] (SampleSpan<DelaySample> toDelay, int offset)
+            {
+                if (gainStep != SampleType())
+                    DelayKernels::writeReadFeedbackMixRamp (channelData + offset, toDelay.data, delayedSamples.data() + offset, toDelay.size,
+                                                            inputGain + gainStep * (SampleType) offset, gainStep, feedback, dry, wet);
+                else if (streaming)
+                    DelayKernels::writeReadFeedbackMixStreaming (channelData + offset, toDelay.data, delayedSamples.data() + offset, toDelay.size,
+                                                                 inputGain, feedback, dry, wet);
+                else
+                    DelayKernels::writeReadFeedbackMix (channelData + offset, toDelay.data, delayedSamples.data() + offset, toDelay.size,
+                                                        inputGain, feedback, dry, wet);
+            };
+
+           #if CIRCULARBUFFERDELAY_COMPRESSED_HISTORY
+            // (a compressed buffer gets what's mixed for it encoded in a pass of its own)
+            writeAndMix ({ samplesToCompress.data(), numSamples }, 0);
+            delayLine.write (channel, samplesToCompress.data(), numSamples);
+           #else
+            delayLine.getWriteRegion (channel, numSamples).forEachSegment (writeAndMix);
+           #endif
+        }
+
+        delayLine.advance (numSamples);
+        start += numSamples;
+
+        // once a crossfade is over, the incoming head (and its allpass state) becomes the current one
+        if (transition.advance (numSamples))
+        {
+            delayReader.copyStateFrom (incomingReader);
+            incomingReader.reset();
         }
     }
-    
-    
-    // step 5
-    // take write position and add buffer.getNumSamples amounts to write position
-    // everytime we are copying, we want write position to keep track of where we're copying to
-    // on the next time we are doing our callback
-    
-    writePosition += bufferSize;
-    
-    //STEP 7
-    // we always want to make sure our write position stays in the bounds of our delay buffer
-    // so when our write position gets to the edge of our delay buffer, it wraps around at the beginning
-    // because the write positon tells us WHERE we need to do the copying
-    // ensure that write position stays between 0 and delayBufferSize
-    writePosition %= delayBufferSize;
 }
 
 //==============================================================================
@@ -219,15 +869,15 @@ juce::AudioProcessorEditor* CircularBufferDelayAudioProcessor::createEditor()
 //==============================================================================
 void CircularBufferDelayAudioProcessor::getStateInformation (juce::MemoryBlock& destData)
 {
-    // You should use this method to store your parameters in the memory block.
-    // You could do that either as raw data, or use the XML or ValueTree classes
-    // as intermediaries to make it easy to save and load complex data.
+    if (auto xml = parameters.copyState().createXml())
+        copyXmlToBinary (*xml, destData);
 }
 
 void CircularBufferDelayAudioProcessor::setStateInformation (const void* data, int sizeInBytes)
 {
-    // You should use this method to restore your parameters from this memory block,
-    // whose contents will have been created by the getStateInformation() call.
+    if (auto xml = getXmlFromBinary (data, sizeInBytes))
+        if (xml->hasTagName (parameters.state.getType()))
+            parameters.replaceState (juce::ValueTree::fromXml (*xml));
 }
 
 //==============================================================================
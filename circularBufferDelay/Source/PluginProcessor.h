@@ -9,11 +9,86 @@
 #pragma once
 
 #include <JuceHeader.h>
+#include "CircularDelayLine.h"
+#include "CompressedDelayLine.h"
+#include "DelayLineResizer.h"
+#include "DelayLineCapture.h"
+#include "DelayInterpolation.h"
+#include "DelayModulator.h"
+#include "DelayTimeTransition.h"
+#include "MultiTapDelay.h"
+#include "DelayTailTracker.h"
+
+// Define this as 1 (e.g. in the Projucer's preprocessor definitions) to take the delay memory of every
+// instance from one arena shared by the whole process, instead of each instance mapping its own
+#ifndef CIRCULARBUFFERDELAY_USE_SHARED_ARENA
+ #define CIRCULARBUFFERDELAY_USE_SHARED_ARENA 0
+#endif
+
+// The delay memory is always faulted in before playback starts; define these as 1 to also
+// lock it into RAM, and (on Linux) to ask for transparent huge pages for long buffers
+#ifndef CIRCULARBUFFERDELAY_LOCK_DELAY_MEMORY
+ #define CIRCULARBUFFERDELAY_LOCK_DELAY_MEMORY 0
+#endif
+
+#ifndef CIRCULARBUFFERDELAY_USE_HUGE_PAGES
+ #define CIRCULARBUFFERDELAY_USE_HUGE_PAGES 0
+#endif
+
+// Clearing the echoes on a transport stop or jump only marks the old history as silent; define this
+// as 1 to also have a background thread zero that memory over the following moments
+#ifndef CIRCULARBUFFERDELAY_CLEAR_IN_BACKGROUND
+ #define CIRCULARBUFFERDELAY_CLEAR_IN_BACKGROUND 0
+#endif
+
+// The delay buffer holds floats whether the host processes in single or double precision; define this
+// as 1 to hold doubles instead (twice the memory and bandwidth, for echoes that go round many more times)
+#ifndef CIRCULARBUFFERDELAY_DOUBLE_PRECISION_HISTORY
+ #define CIRCULARBUFFERDELAY_DOUBLE_PRECISION_HISTORY 0
+#endif
+
+// Define this as 1 to keep the delay buffer's history compressed, in the DelaySampleFormat named by
+// CIRCULARBUFFERDELAY_COMPRESSED_HISTORY_FORMAT (int16, half or packed24), for about half the memory at the cost
+// of a little noise (see CompressedDelayLine). A compressed buffer is built for the longest Max Delay up front
+// instead of being resized in the background; the memory options above, the multi-tap echoes and
+// captureDelayHistory don't apply to it
+#ifndef CIRCULARBUFFERDELAY_COMPRESSED_HISTORY
+ #define CIRCULARBUFFERDELAY_COMPRESSED_HISTORY 0
+#endif
+
+#ifndef CIRCULARBUFFERDELAY_COMPRESSED_HISTORY_FORMAT
+ #define CIRCULARBUFFERDELAY_COMPRESSED_HISTORY_FORMAT int16
+#endif
+
+#if CIRCULARBUFFERDELAY_COMPRESSED_HISTORY && CIRCULARBUFFERDELAY_DOUBLE_PRECISION_HISTORY
+ #error "Compressed history is encoded from floats, so it can't be combined with CIRCULARBUFFERDELAY_DOUBLE_PRECISION_HISTORY"
+#endif
+
+//==============================================================================
+namespace ParameterIDs
+{
+    const char* const delayTime     = "delayTime";
+    const char* const maxDelay      = "maxDelay";
+    const char* const inputGain     = "inputGain";
+    const char* const feedback      = "feedback";
+    const char* const dry           = "dry";
+    const char* const wet           = "wet";
+    const char* const interpolation = "interpolation";
+    const char* const modRate       = "modRate";
+    const char* const modDepth      = "modDepth";
+    const char* const tapCount      = "tapCount";
+    const char* const tapSpacing    = "tapSpacing";
+    const char* const tapDecay      = "tapDecay";
+    const char* const timeChange    = "timeChange";
+    const char* const changeTime    = "changeTime";
+    const char* const clearEchoes   = "clearEchoes";
+}
 
 //==============================================================================
 /**
 */
-class CircularBufferDelayAudioProcessor  : public juce::AudioProcessor
+class CircularBufferDelayAudioProcessor  : public juce::AudioProcessor,
+                                           private juce::Timer
 {
 public:
     //==============================================================================
@@ -29,6 +104,8 @@ public:
    #endif
 
     void processBlock (juce::AudioBuffer<float>&, juce::MidiBuffer&) override;
+    void processBlock (juce::AudioBuffer<double>&, juce::MidiBuffer&) override;
+    bool supportsDoublePrecisionProcessing() const override     { return true; }
 
     //==============================================================================
     juce::AudioProcessorEditor* createEditor() override;
@@ -53,16 +130,150 @@ public:
     void getStateInformation (juce::MemoryBlock& destData) override;
     void setStateInformation (const void* data, int sizeInBytes) override;
 
+    //==============================================================================
+    // the editor attaches its controls to these
+    juce::AudioProcessorValueTreeState parameters;
+
+    // writes the last few seconds of what's gone into the delay buffer to a WAV or FLAC file, on a background
+    // thread; returns false if nothing has gone into the buffer yet, a capture or resize is already under way,
+    // or the file can't be created (and always, if the buffer is compressed: see CIRCULARBUFFERDELAY_COMPRESSED_HISTORY)
+    bool captureDelayHistory (const juce::File& destination, double seconds);
+
 private:
+    static juce::AudioProcessorValueTreeState::ParameterLayout createParameterLayout();
+
+    // the precision the delay buffer and everything that reads it work in, whatever the host's is
+   #if CIRCULARBUFFERDELAY_DOUBLE_PRECISION_HISTORY
+    using DelaySample = double;
+   #else
+    using DelaySample = float;
+   #endif
+
+    // both processBlocks, for a host buffer of floats or doubles
+    template <typename SampleType>
+    void processDelay (juce::AudioBuffer<SampleType>&);
+
+    // the two ways through the delay: a whole-sample read fused into the write,
+    // or an interpolated (and possibly modulated or crossfaded) read into delayedSamples followed by the write
+    // (a compressed buffer always goes the interpolated way, as it has to be decoded to be read at all)
+   #if ! CIRCULARBUFFERDELAY_COMPRESSED_HISTORY
+    template <typename SampleType>
+    void processWholeSampleDelay (juce::AudioBuffer<SampleType>&, int numChannels, int delaySamples);
+   #endif
+    template <typename SampleType>
+    void processInterpolatedDelay (juce::AudioBuffer<SampleType>&, int numChannels, double depthInSamples);
+
+   #if ! CIRCULARBUFFERDELAY_COMPRESSED_HISTORY
+    // adds one channel of the multi-tap echoes into the host buffer, straight in if it has the delay
+    // buffer's precision, otherwise by way of delayedSamples
+    void addTaps (DelaySample* output, int channel, int numSamples, int blockStart, float gain);
+    template <typename SampleType>
+    void addTaps (SampleType* output, int channel, int numSamples, int blockStart, float gain);
+   #endif
+
+    // the input gain at the start of the next numSamples, with how far it moves each sample along them
+    // in gainStep (0 unless the Input Gain parameter has just moved)
+    template <typename SampleType>
+    SampleType advanceInputGain (int numSamples, SampleType& gainStep);
+
+    // how many samples the delay buffer needs for the max delay setting at this sample rate
+    int getDelayBufferSize (double sampleRate, int samplesPerBlock) const;
+
+    // watches the max delay setting from the message thread and asks for a new buffer size when it moves
+    void timerCallback() override;
+
+    // rebuilds the multi-tap pattern from the tap parameters (does nothing if they haven't changed)
+    void updateTaps();
+
+    // when the echoes get dropped, in the same order as the clearEchoes parameter's choices
+    enum class EchoClearing { never, onStop, onStopOrJump };
+
+    // drops every echo in the delay buffer, in no time at all (see CircularDelayLine::clearLazily)
+    void clearEchoes();
+
+    // watches the host's transport and clears the delay buffer (lazily, so in no time at all)
+    // when it stops or, if asked, jumps - e.g. every time round a loop
+    void clearEchoesOnTransportChange (int numSamples);
+
+    std::atomic<float>* delayTimeParameter     = nullptr;
+    std::atomic<float>* maxDelayParameter      = nullptr;
+    std::atomic<float>* inputGainParameter     = nullptr;
+    std::atomic<float>* feedbackParameter      = nullptr;
+    std::atomic<float>* dryParameter           = nullptr;
+    std::atomic<float>* wetParameter           = nullptr;
+    std::atomic<float>* interpolationParameter = nullptr;
+    std::atomic<float>* modRateParameter       = nullptr;
+    std::atomic<float>* modDepthParameter      = nullptr;
+    std::atomic<float>* tapCountParameter      = nullptr;
+    std::atomic<float>* tapSpacingParameter    = nullptr;
+    std::atomic<float>* tapDecayParameter      = nullptr;
+    std::atomic<float>* timeChangeParameter    = nullptr;
+    std::atomic<float>* changeTimeParameter    = nullptr;
+    std::atomic<float>* clearEchoesParameter   = nullptr;
+
     // STEP 1
-    // Declaring delay buffer, tell it what type of samples we want to hold in it (float)
-    // and name it delayBuffer
-    juce::AudioBuffer<float> delayBuffer;
-    
-    // STEP 2
-    // Create a write position to keep track of where we're writing to in this delay buffer
-    // create a variable called writePosition and initialize it to 0
-    int writePosition { 0 };
+    // Our delay buffer and its write position now live together in a CircularDelayLine
+    // holding float (or double, see DelaySample) samples for up to two channels (mono or stereo, see isBusesLayoutSupported)
+    // (or in a CompressedDelayLine, see CIRCULARBUFFERDELAY_COMPRESSED_HISTORY)
+    static constexpr int maxDelayChannels = 2;
+
+   #if CIRCULARBUFFERDELAY_COMPRESSED_HISTORY
+    CompressedDelayLine<DelaySampleFormat::CIRCULARBUFFERDELAY_COMPRESSED_HISTORY_FORMAT, maxDelayChannels> delayLine;
+
+    // a compressed buffer can't be written in place, so what goes into it is mixed here first
+    // (a stretch at a time, like delayedSamples) and encoded from here
+    std::vector<DelaySample> samplesToCompress;
+   #else
+    CircularDelayLine<DelaySample, maxDelayChannels> delayLine;
+
+    // rebuilds delayLine at a new size in the background when the sample rate or the channel
+    // count changes, so the audio thread never allocates and the echoes carry on through it
+    DelayLineResizer<DelaySample, maxDelayChannels> delayLineResizer { delayLine };
+
+    // copies the delay buffer's history out (a slice per block, on the audio thread) and writes it to a file
+    // in the background, for catching a take after the fact; the buffer can't be rebuilt under it, so resizes
+    // wait until it's done
+    DelayLineCapture<DelaySample, maxDelayChannels> delayLineCapture { delayLine };
+   #endif
+
+    // what prepareToPlay last set things up for, so that a call that changes nothing does nothing,
+    // and the buffer size last asked for (both only touched on the message thread)
+    double preparedSampleRate = 0.0;
+    int preparedBlockSize = 0, requestedBufferSize = 0;
+
+    // reads the delay line between samples for delay times that aren't whole samples,
+    // into delayedSamples (one host block long)
+    FractionalDelayReader<DelaySample, maxDelayChannels> delayReader;
+    std::vector<DelaySample> delayedSamples;
+
+    // the chorus/flanger LFO, which fills delayTimes with one delay per sample
+    DelayModulator<DelaySample, maxDelayChannels> modulator;
+    std::vector<DelaySample> delayTimes;
+
+    // moves the read head smoothly when the delay time changes; while it crossfades,
+    // the incoming read head has its own reader and reads into incomingSamples
+    DelayTimeTransition<DelaySample> transition;
+    FractionalDelayReader<DelaySample, maxDelayChannels> incomingReader;
+    std::vector<DelaySample> incomingSamples;
+
+    // extra echoes read from the same delay buffer, all in one pass
+    MultiTapDelay<DelaySample, maxDelayChannels> multiTap;
+
+    // notices when the input and the echoes have all died away, so that processBlock can skip
+    // the blocks after that until something comes in again (audio thread only)
+    DelayTailTracker<DelaySample> tailTracker;
+
+    // where the transport was at the end of the last block, to tell a stop or a jump (audio thread only)
+    bool transportWasPlaying = false;
+    juce::int64 expectedTransportPosition = 0;
+
+    // the gain the input is written into the delay buffer with (it used to be a fixed 0.1f, in the
+    // copyFromWithRamp calls), ramping to a new setting over inputGainRampSeconds rather than jumping
+    static constexpr double inputGainRampSeconds = 0.05;
+
+    // a capture undoes the input gain, but only down to this (the default, so by at most +20 dB)
+    static constexpr float minimumCaptureInputGain = 0.1f;
+    juce::SmoothedValue<float> smoothedInputGain;
 
     //==============================================================================
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (CircularBufferDelayAudioProcessor)